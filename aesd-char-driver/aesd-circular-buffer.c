@@ -10,14 +10,58 @@
 
 #ifdef __KERNEL__
 #include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#define AESD_SLOTS_ALLOC(n)     kvcalloc(n, sizeof(struct aesd_buffer_entry), GFP_KERNEL)
+#define AESD_SLOTS_FREE(p)      kvfree(p)
 #else
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#define AESD_SLOTS_ALLOC(n)     calloc(n, sizeof(struct aesd_buffer_entry))
+#define AESD_SLOTS_FREE(p)      free(p)
 #endif
 
 #include "aesd-circular-buffer.h"
 
+/**
+ * @param buffer the buffer to search for corresponding offset.  Any necessary locking must be performed by caller.
+ * @param char_offset the position to search for in the buffer list, describing the zero referenced
+ *      character index if all buffer strings were concatenated end to end
+ * @param entry_offset_byte_rtn is a pointer specifying a location to store the byte of the returned entry
+ *      buffptr member corresponding to char_offset.  This value is only set when a matching char_offset is found
+ *      in aesd_buffer.
+ * @return the index of the entry holding the position described by char_offset, zero referenced from the
+ * oldest entry, or buffer->count if this position is not available in the buffer (not enough data is written).
+ * The entries are searched by halving on their start, in O(log n).
+ */
+uint32_t aesd_circular_buffer_find_index_for_fpos(struct aesd_circular_buffer *buffer,
+            size_t char_offset, size_t *entry_offset_byte_rtn )
+{
+    uint32_t low = 0, high = buffer->count, mid;
+
+    // Check if position is past the end of the buffer, this covers an empty buffer too
+    if (char_offset >= buffer->end - buffer->start)
+        return buffer->count;
+
+    // Last entry starting at or before char_offset, the sizes of the entries before it add up
+    // to at most char_offset and it holds the byte
+    while (high - low > 1)
+    {
+        mid = low + (high - low) / 2;
+
+        if (aesd_circular_buffer_entry_fpos(buffer, mid) <= char_offset)
+            low = mid;
+        else
+            high = mid;
+    }
+
+    *entry_offset_byte_rtn = char_offset - aesd_circular_buffer_entry_fpos(buffer, low);
+    return low;
+}
+
 /**
  * @param buffer the buffer to search for corresponding offset.  Any necessary locking must be performed by caller.
  * @param char_offset the position to search for in the buffer list, describing the zero referenced
@@ -31,68 +75,161 @@
 struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
             size_t char_offset, size_t *entry_offset_byte_rtn )
 {
-    uint8_t index = buffer->out_offs;
-    
-    // Check if buffer is empty
-    if ((buffer->in_offs == buffer->out_offs) && !buffer->full)
-        return NULL;
+    uint32_t index = aesd_circular_buffer_find_index_for_fpos(buffer, char_offset, entry_offset_byte_rtn);
 
-    do {
-        // If char_offset gets lower than size, then offset should be 
-        // within the current buffptr
-        if (char_offset < buffer->entry[index].size)
-        {
-            *entry_offset_byte_rtn = char_offset; 
-            return &(buffer->entry[index]);
-        }
-        else
-        {
-            char_offset -= buffer->entry[index].size;
-        }
-
-        index++;
-
-        // Wrapping index pointer when reaches the end of buffer
-        if (index == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
-            index = 0;
-            
-    }while (index != buffer->in_offs);
+    if (index == buffer->count)
+        return NULL;
 
-    return NULL;
+    return aesd_circular_buffer_entry(buffer, index);
 }
 
 /**
 * Adds entry @param add_entry to @param buffer in the location specified in buffer->in_offs.
-* If the buffer was already full, overwrites the oldest entry and advances buffer->out_offs to the
-* new start location.
+* If the buffer was already full, overwrites the oldest entry, at buffer->out_offs, and advances
+* buffer->out_offs to the new start location.
 * Any necessary locking must be handled by the caller
 * Any memory referenced in @param add_entry must be allocated by and/or must have a lifetime managed by the caller.
 */
 void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry)
 {
+    // If buffer is full, then old data will be overwritten hence output pointer
+    // has to be changed to new location
+    if (buffer->full)
+    {
+        buffer->start += buffer->entry[buffer->out_offs].size;
+        buffer->entry[buffer->out_offs].buffptr = NULL;
+        buffer->entry[buffer->out_offs].size = 0;
+        buffer->out_offs = (buffer->out_offs + 1) & buffer->mask;
+        buffer->count--;
+    }
+
     buffer->entry[buffer->in_offs].buffptr = add_entry->buffptr;
     buffer->entry[buffer->in_offs].size = add_entry->size;
+    buffer->entry[buffer->in_offs].start = buffer->end;
+    buffer->end += add_entry->size;
 
-    buffer->in_offs++;
-    
     // Wrapping input offset pointer when reaches the end of buffer
-    if (buffer->in_offs == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
-        buffer->in_offs = 0;
+    buffer->in_offs = (buffer->in_offs + 1) & buffer->mask;
+    buffer->count++;
 
-    // If buffer is full, then old data will be overwritten hence output pointer
-    // has to be changed to new location
-    if (buffer->full)
-        buffer->out_offs = buffer->in_offs;
+    buffer->full = buffer->count == buffer->depth;
+}
 
-    // If input and output offset are same then buffer is full
-    if (buffer->in_offs == buffer->out_offs)
-        buffer->full = true;
+/**
+* Removes the oldest entry of @param buffer and copies it to @param removed_entry, the memory it
+* references is then owned by the caller.
+* Any necessary locking must be handled by the caller
+* @return false if the buffer is empty
+*/
+bool aesd_circular_buffer_remove_entry(struct aesd_circular_buffer *buffer,
+            struct aesd_buffer_entry *removed_entry)
+{
+    if (buffer->count == 0)
+        return false;
+
+    *removed_entry = buffer->entry[buffer->out_offs];
+    buffer->start += removed_entry->size;
+
+    buffer->entry[buffer->out_offs].buffptr = NULL;
+    buffer->entry[buffer->out_offs].size = 0;
+    buffer->out_offs = (buffer->out_offs + 1) & buffer->mask;
+    buffer->count--;
+    buffer->full = false;
+
+    return true;
+}
+
+/**
+* Changes the maximum number of entries held by @param buffer to @param depth, entries are
+* moved to a new slot array when the number of slots changes. A depth of up to
+* AESDCHAR_DEFAULT_RING_SLOTS uses the slots embedded in the buffer, a larger one allocates them.
+* The caller must first remove the entries beyond the new depth, oldest first.
+* Shrinking keeps the slots in use when fewer ones can't be allocated, so it never fails.
+* Any necessary locking must be handled by the caller
+* @return 0 on success, -EINVAL when @param depth is out of range or lower than the number of
+* entries held, -ENOMEM when the slots to grow the buffer can't be allocated
+*/
+int aesd_circular_buffer_resize(struct aesd_circular_buffer *buffer, uint32_t depth)
+{
+    struct aesd_buffer_entry *entry;
+    uint32_t slots = 1;
+    uint32_t i;
+
+    if (depth == 0 || depth > AESDCHAR_MAX_RING_DEPTH || depth < buffer->count)
+        return -EINVAL;
+
+    // Smallest power of two holding depth entries
+    while (slots < depth || slots < AESDCHAR_DEFAULT_RING_SLOTS)
+        slots <<= 1;
+
+    if (slots != buffer->mask + 1)
+    {
+        if (slots == AESDCHAR_DEFAULT_RING_SLOTS)
+        {
+            entry = buffer->slots;
+            memset(entry, 0, sizeof(buffer->slots));
+        }
+        else
+        {
+            entry = AESD_SLOTS_ALLOC(slots);
+
+            if (entry == NULL && slots > buffer->mask + 1)
+                return -ENOMEM;
+        }
+
+        // Slots in use hold the new depth as well when fewer can't be allocated
+        if (entry != NULL)
+        {
+            for (i = 0; i < buffer->count; i++)
+                entry[i] = buffer->entry[(buffer->out_offs + i) & buffer->mask];
+
+            if (buffer->entry != buffer->slots)
+                AESD_SLOTS_FREE(buffer->entry);
+
+            buffer->entry = entry;
+            buffer->mask = slots - 1;
+            buffer->out_offs = 0;
+            buffer->in_offs = buffer->count & buffer->mask;
+        }
+    }
+
+    buffer->depth = depth;
+    buffer->full = buffer->count == buffer->depth;
+
+    return 0;
 }
 
 /**
-* Initializes the circular buffer described by @param buffer to an empty struct
+* Initializes the circular buffer described by @param buffer to an empty struct holding at most
+* AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED entries, in the slots embedded in the buffer
 */
 void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer)
 {
     memset(buffer,0,sizeof(struct aesd_circular_buffer));
+    buffer->entry = buffer->slots;
+    buffer->mask = AESDCHAR_DEFAULT_RING_SLOTS - 1;
+    buffer->depth = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+}
+
+/**
+* Initializes the circular buffer described by @param buffer to an empty struct holding at most
+* @param depth entries
+* @return 0 on success, -EINVAL or -ENOMEM as aesd_circular_buffer_resize()
+*/
+int aesd_circular_buffer_init_depth(struct aesd_circular_buffer *buffer, uint32_t depth)
+{
+    aesd_circular_buffer_init(buffer);
+    return aesd_circular_buffer_resize(buffer, depth);
+}
+
+/**
+* Frees the slots allocated for @param buffer and leaves it empty, as after
+* aesd_circular_buffer_init(). The memory referenced by its entries is managed by the caller.
+*/
+void aesd_circular_buffer_free(struct aesd_circular_buffer *buffer)
+{
+    if (buffer->entry != buffer->slots)
+        AESD_SLOTS_FREE(buffer->entry);
+
+    aesd_circular_buffer_init(buffer);
 }
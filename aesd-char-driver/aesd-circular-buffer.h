@@ -16,7 +16,16 @@
 #include <stdbool.h>
 #endif
 
+/**
+ * Default number of records held, the depth is set when the buffer is
+ * initialized and can be changed with aesd_circular_buffer_resize()
+ */
 #define AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED 10
+#define AESDCHAR_MAX_RING_DEPTH (1U << 24)
+/**
+ * Number of slots embedded in the buffer, used while the depth fits in them
+ */
+#define AESDCHAR_DEFAULT_RING_SLOTS 16
 
 struct aesd_buffer_entry
 {
@@ -28,44 +37,105 @@ struct aesd_buffer_entry
      * Number of bytes stored in buffptr
      */
     size_t size;
+    /**
+     * Number of bytes added to the buffer before this entry, set by
+     * aesd_circular_buffer_add_entry()
+     */
+    size_t start;
 };
 
 struct aesd_circular_buffer
 {
     /**
-     * An array of pointers to memory allocated for the most recent write operations
+     * An array of pointers to memory allocated for the most recent write operations,
+     * the number of slots is a power of two and unused slots are zeroed. Points to
+     * slots unless a larger depth is set.
+     */
+    struct aesd_buffer_entry *entry;
+    struct aesd_buffer_entry slots[AESDCHAR_DEFAULT_RING_SLOTS];
+    /**
+     * Number of slots minus one, an index is wrapped by masking it with this value
      */
-    struct aesd_buffer_entry  entry[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    uint32_t mask;
+    /**
+     * The maximum number of entries held, at most the number of slots
+     */
+    uint32_t depth;
+    /**
+     * The number of entries currently held
+     */
+    uint32_t count;
     /**
      * The current location in the entry structure where the next write should
      * be stored.
      */
-    uint8_t in_offs;
+    uint32_t in_offs;
     /**
      * The first location in the entry structure to read from
      */
-    uint8_t out_offs;
+    uint32_t out_offs;
     /**
-     * set to true when the buffer entry structure is full
+     * set to true when the buffer holds depth entries
      */
     bool full;
+    /**
+     * The start of the entry at out_offs, the byte at position fpos is found in
+     * the entry whose start is the greatest one not above start + fpos
+     */
+    size_t start;
+    /**
+     * Number of bytes ever added to the buffer, the end of the newest entry
+     */
+    size_t end;
 };
 
 extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
             size_t char_offset, size_t *entry_offset_byte_rtn );
 
+extern uint32_t aesd_circular_buffer_find_index_for_fpos(struct aesd_circular_buffer *buffer,
+            size_t char_offset, size_t *entry_offset_byte_rtn );
+
 extern void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry);
 
+extern bool aesd_circular_buffer_remove_entry(struct aesd_circular_buffer *buffer,
+            struct aesd_buffer_entry *removed_entry);
+
+extern int aesd_circular_buffer_resize(struct aesd_circular_buffer *buffer, uint32_t depth);
+
 extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
 
+extern int aesd_circular_buffer_init_depth(struct aesd_circular_buffer *buffer, uint32_t depth);
+
+extern void aesd_circular_buffer_free(struct aesd_circular_buffer *buffer);
+
+/**
+ * @return the entry at @param index, zero referenced from the oldest entry held by @param buffer.
+ * index must be lower than buffer->count.
+ */
+static inline struct aesd_buffer_entry *aesd_circular_buffer_entry(struct aesd_circular_buffer *buffer,
+            uint32_t index)
+{
+    return &buffer->entry[(buffer->out_offs + index) & buffer->mask];
+}
+
+/**
+ * @return the position of the first byte of the entry at @param index, zero referenced from
+ * the oldest entry held by @param buffer. index must be lower than buffer->count.
+ */
+static inline size_t aesd_circular_buffer_entry_fpos(struct aesd_circular_buffer *buffer,
+            uint32_t index)
+{
+    return aesd_circular_buffer_entry(buffer, index)->start - buffer->start;
+}
+
 /**
  * Create a for loop to iterate over each member of the circular buffer.
  * Useful when you've allocated memory for circular buffer entries and need to free it
  * @param entryptr is a struct aesd_buffer_entry* to set with the current entry
  * @param buffer is the struct aesd_buffer * describing the buffer
- * @param index is a uint8_t stack allocated value used by this macro for an index
+ * @param index is a uint32_t stack allocated value used by this macro for an index
  * Example usage:
- * uint8_t index;
+ * uint32_t index;
  * struct aesd_circular_buffer buffer;
  * struct aesd_buffer_entry *entry;
  * AESD_CIRCULAR_BUFFER_FOREACH(entry,&buffer,index) {
@@ -74,7 +144,7 @@ extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
  */
 #define AESD_CIRCULAR_BUFFER_FOREACH(entryptr,buffer,index) \
     for(index=0, entryptr=&((buffer)->entry[index]); \
-            index<AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; \
+            index<=(buffer)->mask; \
             index++, entryptr=&((buffer)->entry[index]))
 
 
@@ -33,14 +33,33 @@ struct aesd_seekto {
     uint32_t write_cmd_offset;
 };
 
+/**
+ * A structure to be passed by IOCTL between user space and kernel space, describing the
+ * capacity of the aesdchar driver. The oldest records are dropped to stay within it.
+ */
+struct aesd_limits {
+    /**
+     * The maximum number of records held, from 1 to 16777216
+     */
+    uint32_t depth;
+    uint32_t reserved;
+    /**
+     * The maximum number of bytes held by the records, 0 for no limit
+     */
+    uint64_t max_bytes;
+};
+
 // Pick an arbitrary unused value from https://github.com/torvalds/linux/blob/master/Documentation/userspace-api/ioctl/ioctl-number.rst
 #define AESD_IOC_MAGIC 0x16
 
 // Define a write command from the user point of view, use command number 1
 #define AESDCHAR_IOCSEEKTO _IOWR(AESD_IOC_MAGIC, 1, struct aesd_seekto)
+// Set the capacity, needs CAP_SYS_ADMIN, and get it back
+#define AESDCHAR_IOCSETLIMITS _IOW(AESD_IOC_MAGIC, 2, struct aesd_limits)
+#define AESDCHAR_IOCGETLIMITS _IOR(AESD_IOC_MAGIC, 3, struct aesd_limits)
 /**
  * The maximum number of commands supported, used for bounds checking
  */
-#define AESDCHAR_IOC_MAXNR 1
+#define AESDCHAR_IOC_MAXNR 3
 
 #endif /* AESD_IOCTL_H */
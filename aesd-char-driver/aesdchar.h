@@ -31,11 +31,29 @@ struct aesd_dev
      * TODO: Add structure(s) and locks needed to complete assignment requirements
      */
     struct aesd_circular_buffer cb_buffer;
-    struct aesd_buffer_entry entryptr;
     size_t total_bytes;
-    struct mutex lock;
+    size_t max_bytes;     /* Budget of total_bytes, 0 for no limit */
+    /*
+     * Readers share the lock and copy out in parallel, only the commit of a
+     * record takes it exclusively
+     */
+    struct rw_semaphore lock;
     struct cdev cdev;     /* Char device structure      */
 };
 
+/**
+ * Private data of every open file of the device. A record written in several
+ * calls is staged here until its '\n' arrives, so writers through different
+ * files never mix their partial records and only the commit of a complete
+ * record into cb_buffer takes the device lock.
+ */
+struct aesd_file
+{
+    struct aesd_dev *dev;
+    struct aesd_buffer_entry entryptr;  /* Partial record written so far */
+    size_t capacity;                    /* Bytes allocated to entryptr.buffptr */
+    struct mutex lock;                  /* Serializes writes through this file */
+};
+
 
 #endif /* AESD_CHAR_DRIVER_AESDCHAR_H_ */
@@ -16,7 +16,13 @@
 #include <linux/types.h>
 #include <linux/cdev.h>
 #include <linux/slab.h>
+#include <linux/moduleparam.h>
+#include <linux/capability.h>
+#include <linux/rwsem.h>
 #include <linux/fs.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
+#include <linux/version.h>
 
 #include "aesdchar.h"
 #include "aesd_ioctl.h"
@@ -29,139 +35,221 @@ MODULE_LICENSE("Dual BSD/GPL");
 
 struct aesd_dev aesd_device;
 
+/* Private data of the open files, allocated on every open() */
+static struct kmem_cache *aesd_file_cache;
+
+static uint ring_depth = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+module_param(ring_depth, uint, 0444);
+MODULE_PARM_DESC(ring_depth, "Maximum number of records held (default 10)");
+
+static ulong ring_bytes;
+module_param(ring_bytes, ulong, 0444);
+MODULE_PARM_DESC(ring_bytes, "Maximum number of bytes held by the records, 0 for no limit (default 0)");
+
+/*******************************************************************************
+ * @brief   Frees the oldest records until at most depth of them are held and
+ *          size more bytes fit in the bytes budget. Called with dev->lock held
+ *          for writing.
+ *
+ * @param   dev Device holding the records.
+ * @param   depth Number of records to keep at most.
+ * @param   size Number of bytes about to be added.
+ *
+ * @return  void
+ *******************************************************************************/
+static void aesd_evict_records(struct aesd_dev *dev, uint32_t depth, size_t size)
+{
+    struct aesd_buffer_entry removed;
+
+    while (dev->cb_buffer.count > depth ||
+           (dev->max_bytes && dev->total_bytes + size > dev->max_bytes))
+    {
+        if (!aesd_circular_buffer_remove_entry(&dev->cb_buffer, &removed))
+            break;
+
+        kfree(removed.buffptr);
+        dev->total_bytes -= removed.size;
+    }
+}
+
 int aesd_open(struct inode *inode, struct file *filp)
 {
-    struct aesd_dev *dev;
+    struct aesd_file *file;
 
     PDEBUG("open");
 
-    if (filp->private_data == NULL)
-    {
-        dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
-        filp->private_data = dev;
-    }
+    file = kmem_cache_zalloc(aesd_file_cache, GFP_KERNEL);
+
+    if (file == NULL)
+        return -ENOMEM;
+
+    file->dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
+    mutex_init(&file->lock);
+    filp->private_data = file;
 
     return 0;
 }
 
 int aesd_release(struct inode *inode, struct file *filp)
 {
+    struct aesd_file *file = filp->private_data;
+
     PDEBUG("release");
-    /**
-     * TODO: handle release
-     */
+
+    // A record left without its '\n' is dropped with the file
+    kfree(file->entryptr.buffptr);
+    mutex_destroy(&file->lock);
+    kmem_cache_free(aesd_file_cache, file);
+
     return 0;
 }
 
-ssize_t aesd_read(struct file *filp, char __user *buf, size_t count,
-                  loff_t *f_pos)
+/**
+ * Reads the records from the entry holding the file position into an iov_iter.
+ * read() goes through it as well, and it lets the generic splice helpers move
+ * the device contents into a pipe so that sendfile() and splice() work on the
+ * device without a copy through user space.
+ */
+ssize_t aesd_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
     ssize_t retval = 0;
-    ssize_t offset = 0;
+    size_t offset = 0;
     size_t act_count;
-    size_t rem_count = count;
+    size_t copied;
+    uint32_t index;
     struct aesd_buffer_entry *entryptr;
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_dev *dev = ((struct aesd_file *)iocb->ki_filp->private_data)->dev;
 
-    PDEBUG("read %zu bytes with offset %lld", count, *f_pos);
+    PDEBUG("read %zu bytes with offset %lld", iov_iter_count(to), iocb->ki_pos);
 
-    /**
-     * TODO: handle read
-     */
-    if (mutex_lock_interruptible(&dev->lock))
+    if (down_read_killable(&dev->lock))
         return -ERESTARTSYS;
 
-    /* Loop to read "count" number of bytes from all the entires of
-    circular buffer */
-    do
-    {
-        entryptr = aesd_circular_buffer_find_entry_offset_for_fpos(
-            &dev->cb_buffer,
-            *f_pos, &offset);
+    // Entry holding the first byte, the next ones are read in order from it
+    index = aesd_circular_buffer_find_index_for_fpos(&dev->cb_buffer, iocb->ki_pos, &offset);
 
-        if (entryptr == NULL)
-            goto out;
+    for (; index < dev->cb_buffer.count && iov_iter_count(to); index++, offset = 0)
+    {
+        entryptr = aesd_circular_buffer_entry(&dev->cb_buffer, index);
 
         // Number of bytes to read from current entry buffer
-        act_count = (entryptr->size - offset);
+        act_count = entryptr->size - offset;
 
-        // Cannot read more than requested byte count
-        if (act_count > rem_count)
-            act_count = rem_count;
+        if (act_count > iov_iter_count(to))
+            act_count = iov_iter_count(to);
 
-        if (copy_to_user((void *)buf + (count - rem_count),
-                         (void *)entryptr->buffptr + offset, act_count))
-        {
-            retval = -EFAULT;
-            goto out;
-        }
-
-        rem_count -= act_count;
+        copied = copy_to_iter(entryptr->buffptr + offset, act_count, to);
 
-        *f_pos += act_count;
-        retval += act_count;
+        iocb->ki_pos += copied;
+        retval += copied;
 
-    } while (rem_count);
+        if (copied != act_count)
+        {
+            if (retval == 0)
+                retval = -EFAULT;
+            break;
+        }
+    }
 
-out:
-    mutex_unlock(&dev->lock);
+    up_read(&dev->lock);
     return retval;
 }
 
 ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count,
                    loff_t *f_pos)
 {
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct aesd_buffer_entry *staged = &file->entryptr;
+    size_t max_bytes = READ_ONCE(dev->max_bytes);
+    size_t capacity;
+    char *buffptr;
     ssize_t retval = 0;
 
     PDEBUG("write %zu bytes with offset %lld", count, *f_pos);
 
     /**
-     * TODO: handle write
+     * The record is staged in the file, the device lock is only taken once it
+     * is complete
      */
-    if (mutex_lock_interruptible(&dev->lock))
+    if (mutex_lock_interruptible(&file->lock))
         return -ERESTARTSYS;
 
-    if (dev->entryptr.buffptr)
-        dev->entryptr.buffptr = (char *)krealloc(dev->entryptr.buffptr,
-                                                 dev->entryptr.size + count, GFP_KERNEL);
-    else
-        dev->entryptr.buffptr = (char *)kmalloc(sizeof(char) * count, GFP_KERNEL);
-
-    if (dev->entryptr.buffptr == NULL)
+    // A record can't be larger than what the device may hold
+    if (max_bytes && staged->size + count > max_bytes)
     {
-        PDEBUG("Error while allocating memmory to buffer\n");
-        retval = -ENOMEM;
+        retval = -EFBIG;
         goto out;
     }
 
-    if (copy_from_user((void *)dev->entryptr.buffptr + dev->entryptr.size, buf, count))
+    /*
+     * Buffer is at least doubled when it grows, a record written in many
+     * small calls is copied a constant number of times per byte. A record
+     * written in a single call is allocated to its exact size.
+     */
+    if (staged->size + count > file->capacity)
+    {
+        capacity = max(staged->size + count, file->capacity * 2);
+
+        if (max_bytes && capacity > max_bytes)
+            capacity = max_bytes;
+
+        buffptr = (char *)krealloc(staged->buffptr, capacity, GFP_KERNEL);
+
+        if (buffptr == NULL)
+        {
+            PDEBUG("Error while allocating memmory to buffer\n");
+            retval = -ENOMEM;
+            goto out;
+        }
+
+        staged->buffptr = buffptr;
+        file->capacity = capacity;
+    }
+
+    buffptr = (char *)staged->buffptr + staged->size;
+
+    if (copy_from_user(buffptr, buf, count))
     {
         retval = -EFAULT;
         goto out;
     }
 
-    dev->entryptr.size += count;
+    staged->size += count;
     retval = count;
 
-    // If '\n' is present then add the entry to the circular buffer
-    if (memchr(dev->entryptr.buffptr, '\n', dev->entryptr.size))
+    // If '\n' is present in the bytes just written then add the entry to the circular buffer
+    if (memchr(buffptr, '\n', count))
     {
-        // Free the buffer which was previously added at "in_offs" index
-        if (dev->cb_buffer.entry[dev->cb_buffer.in_offs].buffptr)
+        // Record is kept in a buffer of its size, the slack is released if it can be
+        if (file->capacity > staged->size)
         {
-            kfree(dev->cb_buffer.entry[dev->cb_buffer.in_offs].buffptr);
-            dev->total_bytes -= dev->cb_buffer.entry[dev->cb_buffer.in_offs].size;
+            buffptr = kmemdup(staged->buffptr, staged->size, GFP_KERNEL);
+
+            if (buffptr)
+            {
+                kfree(staged->buffptr);
+                staged->buffptr = buffptr;
+            }
         }
 
-        aesd_circular_buffer_add_entry(&dev->cb_buffer, &dev->entryptr);
-        dev->total_bytes += dev->entryptr.size;
-        dev->entryptr.buffptr = NULL;
-        dev->entryptr.size = 0;
+        down_write(&dev->lock);
+
+        // Make room for the record, oldest records first
+        aesd_evict_records(dev, dev->cb_buffer.depth - 1, staged->size);
+
+        aesd_circular_buffer_add_entry(&dev->cb_buffer, staged);
+        dev->total_bytes += staged->size;
+
+        up_write(&dev->lock);
+
+        staged->buffptr = NULL;
+        staged->size = 0;
+        file->capacity = 0;
     }
 
 out:
-    mutex_unlock(&dev->lock);
+    mutex_unlock(&file->lock);
     return retval;
 }
 
@@ -171,7 +259,7 @@ out:
 loff_t aesd_llseek(struct file *filp, loff_t off, int whence)
 {
     loff_t newpos;
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_dev *dev = ((struct aesd_file *)filp->private_data)->dev;
 
     switch (whence)
     {
@@ -184,10 +272,11 @@ loff_t aesd_llseek(struct file *filp, loff_t off, int whence)
         break;
 
     case 2: /* SEEK_END */
-        if (dev->total_bytes >= off)
-            newpos = dev->total_bytes - off;
-        else
-            return -EINVAL;
+        if (down_read_killable(&dev->lock))
+            return -ERESTARTSYS;
+        // Negative positions are rejected below
+        newpos = dev->total_bytes >= off ? dev->total_bytes - off : -1;
+        up_read(&dev->lock);
         break;
 
     default: /* can't happen */
@@ -216,44 +305,65 @@ loff_t aesd_llseek(struct file *filp, loff_t off, int whence)
 static long aesd_adjust_file_offset(struct file *filp, unsigned int write_cmd,
                                     unsigned int write_cmd_offset)
 {
-    struct aesd_dev *dev = filp->private_data;
-    int retval = 0, cb_size = 0, tmp_fpos = 0, i = 0;
+    struct aesd_dev *dev = ((struct aesd_file *)filp->private_data)->dev;
+    int retval = 0;
 
-    if (mutex_lock_interruptible(&dev->lock))
+    if (down_read_killable(&dev->lock))
         return -ERESTARTSYS;
 
-    // Get circular buffer size
-    if (dev->cb_buffer.in_offs == dev->cb_buffer.out_offs)
-        cb_size = dev->cb_buffer.full ? AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED : 0;
-    else if (dev->cb_buffer.in_offs < dev->cb_buffer.out_offs)
-        cb_size = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - dev->cb_buffer.out_offs +
-                  dev->cb_buffer.in_offs;
-    else
-        cb_size = dev->cb_buffer.in_offs - dev->cb_buffer.out_offs;
-
-    if (write_cmd >= cb_size)
+    if (write_cmd >= dev->cb_buffer.count)
     {
         retval = -EINVAL;
         goto out;
     }
 
-    if (write_cmd_offset >= dev->cb_buffer.entry[write_cmd].size)
+    // Commands are counted from the oldest one held
+    if (write_cmd_offset >= aesd_circular_buffer_entry(&dev->cb_buffer, write_cmd)->size)
     {
         retval = -EINVAL;
         goto out;
     }
 
-    // Calculate sum of all the command buffers size till write_cmd index
-    for (i = 0; i < write_cmd; i++)
-        tmp_fpos += dev->cb_buffer.entry[i].size;
+    // Start of the command is kept by the circular buffer, no need to add up the sizes
+    filp->f_pos = aesd_circular_buffer_entry_fpos(&dev->cb_buffer, write_cmd) + write_cmd_offset;
 
-    // Add offset
-    tmp_fpos += write_cmd_offset;
+out:
+    up_read(&dev->lock);
+    return retval;
+}
+
+/*******************************************************************************
+ * @brief   Changes the number of records and bytes held by the device, the
+ *          oldest records beyond the new limits are freed. The device is
+ *          left unchanged on error.
+ *
+ * @param   dev Device to change.
+ * @param   limits New limits.
+ *
+ * @return  Returns zero on success else error value.
+ *******************************************************************************/
+static long aesd_set_limits(struct aesd_dev *dev, const struct aesd_limits *limits)
+{
+    long retval = 0;
 
-    filp->f_pos = tmp_fpos;
+    if (limits->depth == 0 || limits->depth > AESDCHAR_MAX_RING_DEPTH)
+        return -EINVAL;
 
-out:
-    mutex_unlock(&dev->lock);
+    if (down_write_killable(&dev->lock))
+        return -ERESTARTSYS;
+
+    // Growing allocates the slots before any record is freed, shrinking can't fail
+    if (limits->depth >= dev->cb_buffer.count)
+        retval = aesd_circular_buffer_resize(&dev->cb_buffer, limits->depth);
+
+    if (retval == 0)
+    {
+        dev->max_bytes = limits->max_bytes;
+        aesd_evict_records(dev, limits->depth, 0);
+        retval = aesd_circular_buffer_resize(&dev->cb_buffer, limits->depth);
+    }
+
+    up_write(&dev->lock);
     return retval;
 }
 
@@ -262,7 +372,9 @@ out:
  */
 long aesd_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
+    struct aesd_dev *dev = ((struct aesd_file *)filp->private_data)->dev;
     struct aesd_seekto seekto;
+    struct aesd_limits limits;
     int retval = 0;
 
     /*
@@ -288,6 +400,28 @@ long aesd_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
         }
         break;
 
+    case AESDCHAR_IOCSETLIMITS:
+        if (!capable(CAP_SYS_ADMIN))
+            retval = -EPERM;
+        else if (copy_from_user(&limits, (const void __user *)arg, sizeof(limits)) != 0)
+            retval = -EFAULT;
+        else
+            retval = aesd_set_limits(dev, &limits);
+        break;
+
+    case AESDCHAR_IOCGETLIMITS:
+        memset(&limits, 0, sizeof(limits));
+
+        if (down_read_killable(&dev->lock))
+            return -ERESTARTSYS;
+        limits.depth = dev->cb_buffer.depth;
+        limits.max_bytes = dev->max_bytes;
+        up_read(&dev->lock);
+
+        if (copy_to_user((void __user *)arg, &limits, sizeof(limits)) != 0)
+            retval = -EFAULT;
+        break;
+
     /* Redundant as cmd was checked against MAXNR, but the error can be thrown for
        unhandled cases */
     default:
@@ -299,7 +433,12 @@ long aesd_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 
 struct file_operations aesd_fops = {
     .owner = THIS_MODULE,
-    .read = aesd_read,
+    .read_iter = aesd_read_iter,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+    .splice_read = copy_splice_read,
+#else
+    .splice_read = generic_file_splice_read,
+#endif
     .write = aesd_write,
     .open = aesd_open,
     .release = aesd_release,
@@ -337,16 +476,36 @@ int aesd_init_module(void)
 
     memset(&aesd_device, 0, sizeof(struct aesd_dev));
 
+    aesd_file_cache = KMEM_CACHE(aesd_file, 0);
+
+    if (aesd_file_cache == NULL)
+    {
+        unregister_chrdev_region(dev, 1);
+        return -ENOMEM;
+    }
+
     /**
      * TODO: initialize the AESD specific portion of the device
      */
-    aesd_circular_buffer_init(&aesd_device.cb_buffer);
-    mutex_init(&aesd_device.lock);
+    result = aesd_circular_buffer_init_depth(&aesd_device.cb_buffer, ring_depth);
+
+    if (result)
+    {
+        printk(KERN_WARNING "Can't hold %u records\n", ring_depth);
+        kmem_cache_destroy(aesd_file_cache);
+        unregister_chrdev_region(dev, 1);
+        return result;
+    }
+
+    aesd_device.max_bytes = ring_bytes;
+    init_rwsem(&aesd_device.lock);
 
     result = aesd_setup_cdev(&aesd_device);
 
     if (result)
     {
+        aesd_circular_buffer_free(&aesd_device.cb_buffer);
+        kmem_cache_destroy(aesd_file_cache);
         unregister_chrdev_region(dev, 1);
     }
     return result;
@@ -355,7 +514,7 @@ int aesd_init_module(void)
 void aesd_cleanup_module(void)
 {
     struct aesd_buffer_entry *entryptr;
-    uint8_t index = 0;
+    uint32_t index = 0;
 
     dev_t devno = MKDEV(aesd_major, aesd_minor);
 
@@ -369,7 +528,8 @@ void aesd_cleanup_module(void)
         if (entryptr->buffptr)
             kfree(entryptr->buffptr);
     }
-    mutex_destroy(&aesd_device.lock);
+    aesd_circular_buffer_free(&aesd_device.cb_buffer);
+    kmem_cache_destroy(aesd_file_cache);
 
     unregister_chrdev_region(devno, 1);
 }
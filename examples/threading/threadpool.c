@@ -0,0 +1,235 @@
+#include "threadpool.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// Optional: use these functions to add debug or error prints to your application
+#define DEBUG_LOG(msg,...)
+//#define DEBUG_LOG(msg,...) printf("threadpool: " msg "\n" , ##__VA_ARGS__)
+#define ERROR_LOG(msg,...) printf("threadpool ERROR: " msg "\n" , ##__VA_ARGS__)
+
+static bool worker_push(struct threadpool_worker *worker, struct threadpool_task *task)
+{
+    bool status = false;
+
+    pthread_mutex_lock(&worker->lock);
+
+    if (worker->count < worker->pool->queue_depth)
+    {
+        worker->tasks[(worker->head + worker->count) % worker->pool->queue_depth] = *task;
+        worker->count++;
+        status = true;
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return status;
+}
+
+// Owner takes the oldest task from the head of its own deque
+static bool worker_pop(struct threadpool_worker *worker, struct threadpool_task *task)
+{
+    bool status = false;
+
+    pthread_mutex_lock(&worker->lock);
+
+    if (worker->count > 0)
+    {
+        *task = worker->tasks[worker->head];
+        worker->head = (worker->head + 1) % worker->pool->queue_depth;
+        worker->count--;
+        status = true;
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return status;
+}
+
+// Thieves take the newest task from the tail of the victim deque
+static bool worker_steal(struct threadpool_worker *victim, struct threadpool_task *task)
+{
+    bool status = false;
+
+    if (pthread_mutex_trylock(&victim->lock) != 0)
+        return false;
+
+    if (victim->count > 0)
+    {
+        victim->count--;
+        *task = victim->tasks[(victim->head + victim->count) % victim->pool->queue_depth];
+        status = true;
+    }
+
+    pthread_mutex_unlock(&victim->lock);
+
+    return status;
+}
+
+static bool worker_get_task(struct threadpool_worker *worker, struct threadpool_task *task)
+{
+    struct threadpool *pool = worker->pool;
+    int i;
+
+    if (worker_pop(worker, task))
+        return true;
+
+    for (i = 1; i < pool->num_workers; i++)
+    {
+        if (worker_steal(&pool->workers[(worker->id + i) % pool->num_workers], task))
+        {
+            DEBUG_LOG("worker %d stole a task", worker->id);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void* worker_func(void* worker_param)
+{
+    struct threadpool_worker *worker = (struct threadpool_worker *) worker_param;
+    struct threadpool *pool = worker->pool;
+    struct threadpool_task task;
+
+    while (true)
+    {
+        if (worker_get_task(worker, &task))
+        {
+            atomic_fetch_sub(&pool->pending, 1);
+            task.func(task.arg);
+            continue;
+        }
+
+        // Park until a task is submitted, pending is rechecked under park_lock so no wakeup is lost
+        pthread_mutex_lock(&pool->park_lock);
+        atomic_fetch_add(&pool->parked, 1);
+
+        while (atomic_load(&pool->pending) == 0 && !atomic_load(&pool->shutdown))
+            pthread_cond_wait(&pool->park_cond, &pool->park_lock);
+
+        atomic_fetch_sub(&pool->parked, 1);
+        pthread_mutex_unlock(&pool->park_lock);
+
+        if (atomic_load(&pool->shutdown) && atomic_load(&pool->pending) == 0)
+            break;
+    }
+
+    return worker_param;
+}
+
+
+bool threadpool_init(struct threadpool *pool, int num_workers, int queue_depth)
+{
+    int i;
+
+    if (num_workers <= 0 || queue_depth <= 0)
+    {
+        ERROR_LOG("Invalid number of workers %d or queue depth %d", num_workers, queue_depth);
+        return false;
+    }
+
+    pool->num_workers = 0;
+    pool->queue_depth = queue_depth;
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->parked, 0);
+    atomic_init(&pool->next_worker, 0);
+    atomic_init(&pool->shutdown, false);
+    pthread_mutex_init(&pool->park_lock, NULL);
+    pthread_cond_init(&pool->park_cond, NULL);
+
+    pool->workers = (struct threadpool_worker*) calloc(num_workers, sizeof(struct threadpool_worker));
+
+    if (pool->workers == NULL)
+    {
+        ERROR_LOG("Could not allocate memory to workers");
+        return false;
+    }
+
+    for (i = 0; i < num_workers; i++)
+    {
+        struct threadpool_worker *worker = &pool->workers[i];
+
+        worker->tasks = (struct threadpool_task*) malloc(queue_depth * sizeof(struct threadpool_task));
+
+        if (worker->tasks == NULL)
+        {
+            ERROR_LOG("Could not allocate memory to worker %d queue", i);
+            threadpool_destroy(pool);
+            return false;
+        }
+
+        worker->id = i;
+        worker->pool = pool;
+        pthread_mutex_init(&worker->lock, NULL);
+
+        if (pthread_create(&worker->thread, NULL, worker_func, (void*)worker) != 0)
+        {
+            ERROR_LOG("Could not create worker %d thread", i);
+            pthread_mutex_destroy(&worker->lock);
+            free(worker->tasks);
+            threadpool_destroy(pool);
+            return false;
+        }
+
+        pool->num_workers++;
+    }
+
+    return true;
+}
+
+bool threadpool_submit(struct threadpool *pool, void (*func)(void *arg), void *arg)
+{
+    struct threadpool_task task = { .func = func, .arg = arg };
+    unsigned int start = atomic_fetch_add(&pool->next_worker, 1);
+    int i;
+
+    if (atomic_load(&pool->shutdown))
+        return false;
+
+    // Counted before the push so that a worker never sees a queued task with pending at 0
+    atomic_fetch_add(&pool->pending, 1);
+
+    for (i = 0; i < pool->num_workers; i++)
+    {
+        if (worker_push(&pool->workers[(start + i) % pool->num_workers], &task))
+        {
+            if (atomic_load(&pool->parked) > 0)
+            {
+                pthread_mutex_lock(&pool->park_lock);
+                pthread_cond_signal(&pool->park_cond);
+                pthread_mutex_unlock(&pool->park_lock);
+            }
+
+            return true;
+        }
+    }
+
+    atomic_fetch_sub(&pool->pending, 1);
+
+    DEBUG_LOG("all the worker queues are full");
+    return false;
+}
+
+void threadpool_destroy(struct threadpool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->park_lock);
+    atomic_store(&pool->shutdown, true);
+    pthread_cond_broadcast(&pool->park_cond);
+    pthread_mutex_unlock(&pool->park_lock);
+
+    for (i = 0; i < pool->num_workers; i++)
+    {
+        pthread_join(pool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool->workers[i].lock);
+        free(pool->workers[i].tasks);
+    }
+
+    free(pool->workers);
+    pool->workers = NULL;
+    pool->num_workers = 0;
+
+    pthread_mutex_destroy(&pool->park_lock);
+    pthread_cond_destroy(&pool->park_cond);
+}
@@ -0,0 +1,72 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/**
+ * A unit of work queued to the pool, func is called with arg by one of the
+ * workers.
+ */
+struct threadpool_task{
+    void (*func)(void *arg);
+    void *arg;
+};
+
+struct threadpool;
+
+/**
+ * Each worker owns a bounded deque of tasks. The owner takes the oldest task
+ * from the head, idle workers steal the newest task from the tail.
+ */
+struct threadpool_worker{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    struct threadpool_task *tasks;
+    int head;
+    int count;
+    int id;
+    struct threadpool *pool;
+};
+
+struct threadpool{
+    struct threadpool_worker *workers;
+    int num_workers;
+    int queue_depth;
+
+    /*
+     * Number of queued tasks not yet taken by a worker and number of
+     * workers parked on park_cond waiting for a task.
+     */
+    atomic_int pending;
+    atomic_int parked;
+    pthread_mutex_t park_lock;
+    pthread_cond_t park_cond;
+
+    // Worker the next task is submitted to
+    atomic_uint next_worker;
+    atomic_bool shutdown;
+};
+
+
+/**
+* Initialize @param pool and start @param num_workers worker threads, each with a deque holding at most
+* @param queue_depth tasks.
+* @return true if all the workers could be started, false if a failure occurred.
+*/
+bool threadpool_init(struct threadpool *pool, int num_workers, int queue_depth);
+
+/**
+* Queue a task calling @param func with @param arg to @param pool. Tasks are spread over the workers in
+* round-robin order, a task going to a full deque is placed on the next worker with room.
+* @return true if the task is queued, false if the deques of all the workers are full.
+*/
+bool threadpool_submit(struct threadpool *pool, void (*func)(void *arg), void *arg);
+
+/**
+* Wait for the tasks already queued to @param pool to complete, stop the workers and free the deques.
+*/
+void threadpool_destroy(struct threadpool *pool);
+
+#endif /* THREADPOOL_H */
@@ -0,0 +1,277 @@
+/*******************************************************************************
+ * @file    admission.c
+ * @brief   Admission control of aesdsocket. Bounds what abusive clients can
+ *          hold so that the well-behaved ones keep being served:
+ *
+ *          - Connections above the cap (-C) are closed right after accept.
+ *          - Receive buffers are charged to a per-connection (-B) and a
+ *            global (-G) byte budget, a connection whose buffer would grow
+ *            past either of them is shed.
+ *          - Connections making no progress for the idle timeout (-T) are
+ *            shut down by a job of the timer thread. The read deadline runs
+ *            while a request is awaited and the write deadline while a reply
+ *            is stalled, a subscriber waiting for records has none.
+ *
+ *          With an idle timeout admitted connections are listed under
+ *          admission_lock, which is held by connection_close until the socket
+ *          is removed, so the idle job never shuts down a descriptor that was
+ *          already reused. Without one the list and the lock are not touched,
+ *          accepts and closes of the threads then share no lock here.
+ *          shutdown() wakes up a thread blocked on the socket and raises
+ *          EPOLLHUP for an event loop, the owner then closes the connection.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "aesdsocket.h"
+#include "metrics.h"
+#include "logger.h"
+
+#define ADMISSION_MIN_SWEEP_MS  (10)
+
+LIST_HEAD(admission_list_head_t, connection);
+
+static struct admission_list_head_t admitted_list = LIST_HEAD_INITIALIZER(admitted_list);
+static pthread_mutex_t admission_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int num_admitted;
+static atomic_size_t buffered_bytes;
+
+static void admission_sweep(void *arg);
+
+/**
+ * @brief   Starts the idle sweep when an idle timeout is configured. The
+ *          connections are checked twice per timeout.
+ *
+ * @param   void
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int admission_start(void)
+{
+    unsigned int period_ms;
+    int job_id;
+
+    if (server_config.idle_timeout_ms == 0)
+        return 0;
+
+    period_ms = server_config.idle_timeout_ms / 2;
+
+    if (period_ms < ADMISSION_MIN_SWEEP_MS)
+        period_ms = ADMISSION_MIN_SWEEP_MS;
+
+    job_id = timer_schedule(period_ms, period_ms, admission_sweep, NULL);
+
+    if (job_id < 0)
+    {
+        printf("Failed to schedule the idle sweep\n");
+        syslog(LOG_ERR, "Failed to schedule the idle sweep");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Admits a newly accepted connection when it is below the
+ *          connection cap and lists it for the idle sweep when an idle
+ *          timeout is configured.
+ *
+ * @param   conn: Connection being initialized.
+ *
+ * @return  Returns 0 when admitted and -1 when the cap is reached.
+ */
+int admission_open(struct connection *conn)
+{
+    if (server_config.max_connections &&
+        atomic_fetch_add(&num_admitted, 1) >= server_config.max_connections)
+    {
+        atomic_fetch_sub(&num_admitted, 1);
+        metrics_add(METRIC_CONN_REJECTED, 1);
+        LOGGER_POST(LOG_WARNING, "Connection limit reached, rejecting", &conn->addr, 0);
+        return -1;
+    }
+
+    conn->admitted = true;
+
+    // Only the idle sweep walks the list
+    if (server_config.idle_timeout_ms == 0)
+        return 0;
+
+    admission_touch(conn);
+
+    pthread_mutex_lock(&admission_lock);
+    LIST_INSERT_HEAD(&admitted_list, conn, admitted_entries);
+    pthread_mutex_unlock(&admission_lock);
+
+    return 0;
+}
+
+/**
+ * @brief   Closes the socket of an admitted connection with it unlisted
+ *          from the idle sweep, and releases its slot.
+ *
+ * @param   conn: Connection being closed.
+ *
+ * @return  void
+ */
+void admission_close(struct connection *conn)
+{
+    if (!conn->admitted)
+    {
+        close(conn->sock_fd);
+        return;
+    }
+
+    conn->admitted = false;
+
+    if (server_config.idle_timeout_ms)
+    {
+        pthread_mutex_lock(&admission_lock);
+        LIST_REMOVE(conn, admitted_entries);
+        close(conn->sock_fd);
+        pthread_mutex_unlock(&admission_lock);
+    }
+    else
+    {
+        close(conn->sock_fd);
+    }
+
+    if (server_config.max_connections)
+        atomic_fetch_sub(&num_admitted, 1);
+}
+
+/**
+ * @brief   Charges the growth of a receive buffer to the budgets. The new
+ *          size is trimmed to the per-connection budget when the buffered
+ *          bytes still fit in it.
+ *
+ * @param   cap: Current size of the buffer.
+ * @param   new_cap: Size the buffer is grown to, trimmed when needed.
+ * @param   required: Bytes the buffer has to hold.
+ *
+ * @return  Returns 0 on success and -1 with errno set to ENOBUFS when a
+ *          budget is exceeded.
+ */
+int admission_charge(size_t cap, size_t *new_cap, size_t required)
+{
+    size_t limit = server_config.conn_buffer_limit;
+
+    if (limit && *new_cap > limit)
+    {
+        if (required > limit)
+        {
+            metrics_add(METRIC_CONN_SHED, 1);
+            errno = ENOBUFS;
+            return -1;
+        }
+
+        *new_cap = limit;
+    }
+
+    limit = server_config.buffer_limit;
+
+    if (limit && atomic_fetch_add(&buffered_bytes, *new_cap - cap) + *new_cap - cap > limit)
+    {
+        atomic_fetch_sub(&buffered_bytes, *new_cap - cap);
+        metrics_add(METRIC_CONN_SHED, 1);
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Returns the bytes of a freed receive buffer to the global budget.
+ *
+ * @param   cap: Size of the freed buffer.
+ *
+ * @return  void
+ */
+void admission_release(size_t cap)
+{
+    if (server_config.buffer_limit)
+        atomic_fetch_sub(&buffered_bytes, cap);
+}
+
+/**
+ * @brief   Restarts the idle deadline of the connection, called on every
+ *          progress of its reads and writes.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  void
+ */
+void admission_touch(struct connection *conn)
+{
+    struct timespec now;
+
+    if (server_config.idle_timeout_ms == 0)
+        return;
+
+    // Coarse clock is enough for deadlines of milliseconds and costs no system call
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+    atomic_store_explicit(&conn->active_ms, (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000,
+                          memory_order_relaxed);
+}
+
+/**
+ * @brief   Clears the idle deadline of the connection until the next
+ *          admission_touch(), used while it legitimately waits.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  void
+ */
+void admission_idle(struct connection *conn)
+{
+    atomic_store_explicit(&conn->active_ms, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief   Timer job shutting down the connections which made no progress
+ *          for the idle timeout.
+ *
+ * @param   arg: Unused.
+ *
+ * @return  void
+ */
+static void admission_sweep(void *arg)
+{
+    struct connection *conn;
+    struct timespec now;
+    uint64_t now_ms, active_ms;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    now_ms = (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+    pthread_mutex_lock(&admission_lock);
+
+    LIST_FOREACH(conn, &admitted_list, admitted_entries)
+    {
+        active_ms = atomic_load_explicit(&conn->active_ms, memory_order_relaxed);
+
+        if (active_ms == 0 || now_ms - active_ms < server_config.idle_timeout_ms)
+            continue;
+
+        // Not swept again, the owner closes the connection once woken up
+        atomic_store_explicit(&conn->active_ms, 0, memory_order_relaxed);
+        shutdown(conn->sock_fd, SHUT_RDWR);
+
+        metrics_add(METRIC_CONN_TIMED_OUT, 1);
+        LOGGER_POST(LOG_WARNING, "Connection idle for too long, closing", &conn->addr, 0);
+    }
+
+    pthread_mutex_unlock(&admission_lock);
+}
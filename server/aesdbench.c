@@ -0,0 +1,1018 @@
+/*******************************************************************************
+ * @file    aesdbench.c
+ * @brief   Load generator and benchmark for aesdsocket. Opens a number of
+ *          concurrent client connections, each sending records of a given
+ *          size at a given rate (or as fast as the replies allow), optionally
+ *          mixed with "AESDCHAR_IOCSEEKTO:X,Y" commands. Every reply to a
+ *          record is checked to carry the record back, a reply missing it is
+ *          counted as a mismatch. Throughput and p50/p99/p999 latencies of
+ *          the records are reported once all the clients are done.
+ *
+ *          By default every record is sent on a new connection and its reply
+ *          is read till the server closes the connection, which matches the
+ *          default mode of aesdsocket. With -k a connection is kept open for
+ *          all the records of a client (aesdsocket -k or -i), the reply to a
+ *          record is complete once the record is received back.
+ *
+ *          With -b the clients switch their connection to the binary framed
+ *          protocol and send every batch of records as appends followed by a
+ *          read, all in one round trip. Like aesdsocket -i the read carries
+ *          the bytes appended since the previous one, checked to carry the
+ *          last record of the batch.
+ *
+ *          With -L the clients disable Nagle and send the record of a new
+ *          connection in its SYN with TCP Fast Open, to be compared against
+ *          aesdsocket -L.
+ *
+ *          With -u the clients connect to the Unix domain listener of
+ *          aesdsocket instead of its TCP port.
+ *
+ *          When rate limited the latency is measured from the time the record
+ *          was scheduled to be sent, so a stalled server is not hidden by the
+ *          clients sending less.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <endian.h>
+
+#include "frame.h"
+
+#define DEFAULT_HOST        ("127.0.0.1")
+#define DEFAULT_PORT        ("9000")
+#define DEFAULT_CONNECTIONS (1)
+#define DEFAULT_RECORDS     (1000)
+#define DEFAULT_RECORD_SIZE (64)
+#define REPLY_BUFFER_SIZE   (64 * 1024)
+#define FRAME_CMD_LINE      ("AESDCHAR_BINARY\n")
+
+struct bench_config
+{
+    const char *host;
+    const char *port;
+    const char *unix_path;
+    int connections;
+    int records;
+    int record_size;
+    int rate;
+    int seek_every;
+    unsigned int seek_cmd;
+    unsigned int seek_offset;
+    bool keep_alive;
+    bool low_latency;
+    int batch;
+};
+
+/**
+ * Bytes received on a connection which are not yet matched to a reply.
+ */
+struct reply_reader
+{
+    char *data;
+    size_t cap;
+    size_t len;
+};
+
+struct bench_client
+{
+    pthread_t thread_id;
+    int id;
+    int sock_fd;
+    struct reply_reader reader;
+    uint64_t read_cursor;       // Bytes already read over the binary protocol
+
+    // Latency of every completed record in nanoseconds
+    uint64_t *latencies;
+    int num_latencies;
+
+    uint64_t records;
+    uint64_t seekto;
+    uint64_t errors;
+    uint64_t mismatches;
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+};
+
+static struct bench_config bench_config = {
+    .host = DEFAULT_HOST,
+    .port = DEFAULT_PORT,
+    .unix_path = NULL,
+    .connections = DEFAULT_CONNECTIONS,
+    .records = DEFAULT_RECORDS,
+    .record_size = DEFAULT_RECORD_SIZE,
+    .rate = 0,
+    .seek_every = 0,
+    .seek_cmd = 0,
+    .seek_offset = 0,
+    .keep_alive = false,
+    .low_latency = false,
+    .batch = 0,
+};
+
+static struct addrinfo *server_addr;
+static struct sockaddr_un server_unix_addr;
+
+static void *client_thread(void *client_data);
+static int client_send_record(struct bench_client *client, const char *record, size_t record_len);
+static int client_send_seekto(struct bench_client *client);
+static int client_send_batch(struct bench_client *client, char *batch, size_t batch_len, const char *record,
+                             size_t record_len);
+static int bench_connect(void);
+static int send_all(int fd, const char *data, size_t len, uint64_t *bytes_out);
+static int recv_all(int fd, void *data, size_t len, uint64_t *bytes_in);
+static int frame_reply_read(int fd, struct reply_reader *reader, uint8_t opcode, const char *needle,
+                            size_t needle_len, uint32_t *length, uint64_t *bytes_in);
+static int reply_read(int fd, struct reply_reader *reader, const char *needle, size_t needle_len,
+                      bool until_eof, uint64_t *bytes_in);
+static uint64_t time_now(void);
+static int compare_latency(const void *a, const void *b);
+static void print_report(struct bench_client *clients, uint64_t elapsed_ns);
+static int parse_args(int argc, char **argv);
+static void print_usage(void);
+
+
+int main(int argc, char **argv)
+{
+    struct addrinfo hints;
+    struct bench_client *clients;
+    uint64_t start_ns;
+    int started = 0;
+    int ret_status;
+    int i;
+
+    if (parse_args(argc, argv))
+    {
+        print_usage();
+        return -1;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (bench_config.unix_path)
+    {
+        server_unix_addr.sun_family = AF_UNIX;
+        strncpy(server_unix_addr.sun_path, bench_config.unix_path, sizeof(server_unix_addr.sun_path) - 1);
+    }
+    else
+    {
+        ret_status = getaddrinfo(bench_config.host, bench_config.port, &hints, &server_addr);
+
+        if (ret_status)
+        {
+            printf("Failed to resolve %s:%s: %s\n", bench_config.host, bench_config.port, gai_strerror(ret_status));
+            return -1;
+        }
+    }
+
+    clients = calloc(bench_config.connections, sizeof(struct bench_client));
+
+    if (clients == NULL)
+    {
+        printf("Error while allocating memmory to clients\n");
+
+        if (server_addr)
+            freeaddrinfo(server_addr);
+
+        return -1;
+    }
+
+    start_ns = time_now();
+
+    for (i = 0; i < bench_config.connections; i++)
+    {
+        clients[i].id = i;
+        clients[i].sock_fd = -1;
+
+        ret_status = pthread_create(&clients[i].thread_id, NULL, client_thread, &clients[i]);
+
+        if (ret_status != 0)
+        {
+            printf("Error while creating the client thread: %s\n", strerror(ret_status));
+            break;
+        }
+
+        started++;
+    }
+
+    for (i = 0; i < started; i++)
+        pthread_join(clients[i].thread_id, NULL);
+
+    if (started == bench_config.connections)
+        print_report(clients, time_now() - start_ns);
+
+    ret_status = started == bench_config.connections ? 0 : -1;
+
+    for (i = 0; i < started; i++)
+    {
+        if (clients[i].errors || clients[i].mismatches)
+            ret_status = 1;
+
+        free(clients[i].latencies);
+        free(clients[i].reader.data);
+    }
+
+    free(clients);
+
+    if (server_addr)
+        freeaddrinfo(server_addr);
+
+    return ret_status;
+}
+
+/**
+ * @brief   Client thread, sends all the records of the client and records
+ *          the latency of each of them.
+ *
+ * @param   client_data: struct bench_client of this thread.
+ *
+ * @return  void
+ */
+static void *client_thread(void *client_data)
+{
+    struct bench_client *client = (struct bench_client *)client_data;
+    struct timespec next_time;
+    uint64_t interval_ns = 0;
+    uint64_t start_ns;
+    uint64_t scheduled_ns = 0;
+    uint64_t latency_ns;
+    struct frame_header header = { .opcode = FRAME_OP_APPEND };
+    size_t buffer_size = bench_config.record_size + 64;
+    size_t batch_len = 0;
+    char *buffer;
+    char *record;
+    int record_len;
+    int num_records = 0;
+    int ret_status;
+    int i;
+
+    // Frames of a batch are built in the buffer, followed by the read
+    if (bench_config.batch)
+        buffer_size = bench_config.batch * (sizeof(struct frame_header) + buffer_size) +
+                      sizeof(struct frame_header) + sizeof(struct frame_read);
+
+    buffer = malloc(buffer_size);
+    record = buffer;
+    client->latencies = malloc(bench_config.records * sizeof(uint64_t));
+    client->reader.cap = bench_config.record_size + 64 + REPLY_BUFFER_SIZE;
+    client->reader.data = malloc(client->reader.cap);
+
+    if (buffer == NULL || client->latencies == NULL || client->reader.data == NULL)
+    {
+        printf("Error while allocating memmory to client %d\n", client->id);
+        client->errors++;
+        free(buffer);
+        return NULL;
+    }
+
+    if (bench_config.rate > 0)
+        interval_ns = 1000000000ULL / bench_config.rate;
+
+    start_ns = time_now();
+
+    for (i = 0; i < bench_config.records; i++)
+    {
+        // Records of a batch are sent at the time of the first one
+        if (num_records == 0)
+            scheduled_ns = time_now();
+
+        // Wait for the send time of the record, latency is counted from it
+        if (interval_ns && num_records == 0)
+        {
+            scheduled_ns = start_ns + i * interval_ns;
+            next_time.tv_sec = scheduled_ns / 1000000000;
+            next_time.tv_nsec = scheduled_ns % 1000000000;
+
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_time, NULL) == EINTR)
+                ;
+        }
+
+        if (bench_config.seek_every && (i + 1) % bench_config.seek_every == 0)
+        {
+            if (client_send_seekto(client))
+                client->errors++;
+            else
+                client->seekto++;
+
+            continue;
+        }
+
+        if (bench_config.batch)
+            record = buffer + batch_len + sizeof(struct frame_header);
+
+        // Every record is unique so that its reply can be identified
+        record_len = snprintf(record, bench_config.record_size + 64, "c%d-r%d-", client->id, i);
+
+        while (record_len < bench_config.record_size - 1)
+            record[record_len++] = 'x';
+
+        record[record_len++] = '\n';
+        num_records++;
+
+        if (bench_config.batch)
+        {
+            header.length = htobe32(record_len);
+            memcpy(buffer + batch_len, &header, sizeof(header));
+            batch_len += sizeof(header) + record_len;
+
+            if (num_records < bench_config.batch && i + 1 < bench_config.records)
+                continue;
+
+            ret_status = client_send_batch(client, buffer, batch_len, record, record_len);
+            batch_len = 0;
+        }
+        else
+        {
+            ret_status = client_send_record(client, record, record_len);
+        }
+
+        if (ret_status < 0)
+        {
+            client->errors++;
+            num_records = 0;
+            continue;
+        }
+
+        if (ret_status == 0)
+            client->mismatches++;
+
+        client->records += num_records;
+        latency_ns = time_now() - scheduled_ns;
+
+        for (; num_records > 0; num_records--)
+            client->latencies[client->num_latencies++] = latency_ns;
+    }
+
+    if (client->sock_fd >= 0)
+        close(client->sock_fd);
+
+    free(buffer);
+
+    return NULL;
+}
+
+/**
+ * @brief   Sends a record and reads its reply. A new connection is used for
+ *          every record unless keep-alive is enabled.
+ *
+ * @param   client: Client sending the record.
+ * @param   record: Record including the '\n' character.
+ * @param   record_len: Length of the record.
+ *
+ * @return  Returns 1 when the reply carries the record, 0 when it does not
+ *          and -1 on error.
+ */
+static int client_send_record(struct bench_client *client, const char *record, size_t record_len)
+{
+    int ret_status;
+
+    if (client->sock_fd < 0)
+    {
+        client->sock_fd = bench_connect();
+        client->reader.len = 0;
+
+        if (client->sock_fd < 0)
+            return -1;
+    }
+
+    if (send_all(client->sock_fd, record, record_len, &client->bytes_out))
+    {
+        ret_status = -1;
+    }
+    else if (bench_config.keep_alive)
+    {
+        ret_status = reply_read(client->sock_fd, &client->reader, record, record_len, false, &client->bytes_in);
+    }
+    else
+    {
+        // Server replies and closes the connection once the write side is shut
+        shutdown(client->sock_fd, SHUT_WR);
+        ret_status = reply_read(client->sock_fd, &client->reader, record, record_len, true, &client->bytes_in);
+    }
+
+    if (ret_status < 0 || !bench_config.keep_alive)
+    {
+        close(client->sock_fd);
+        client->sock_fd = -1;
+    }
+
+    return ret_status;
+}
+
+/**
+ * @brief   Sends a batch of appends followed by a read from the cursor of
+ *          the client and reads its reply. The connection is switched to the binary
+ *          protocol when opened and kept open for all the batches.
+ *
+ * @param   client: Client sending the batch.
+ * @param   batch: Append frames, with room for the read frame after them.
+ * @param   batch_len: Length of the append frames.
+ * @param   record: Last record of the batch.
+ * @param   record_len: Length of the record.
+ *
+ * @return  Returns 1 when the tail carries the record, 0 when it does not
+ *          and -1 on error.
+ */
+static int client_send_batch(struct bench_client *client, char *batch, size_t batch_len, const char *record,
+                             size_t record_len)
+{
+    struct frame_header header = { .opcode = FRAME_OP_READ };
+    struct frame_read request;
+    uint32_t length = 0;
+    int ret_status;
+
+    if (client->sock_fd < 0)
+    {
+        client->sock_fd = bench_connect();
+        client->reader.len = 0;
+        client->read_cursor = 0;
+
+        if (client->sock_fd < 0)
+            return -1;
+
+        if (send_all(client->sock_fd, FRAME_CMD_LINE, FRAME_CMD_LEN + 1, &client->bytes_out) ||
+            frame_reply_read(client->sock_fd, &client->reader, FRAME_OP_HELLO, NULL, 0, NULL, &client->bytes_in) < 0)
+        {
+            close(client->sock_fd);
+            client->sock_fd = -1;
+            return -1;
+        }
+    }
+
+    // Everything appended since the previous read, trimmed by the server
+    header.length = htobe32(sizeof(request));
+    request.offset = htobe64(client->read_cursor);
+    request.length = htobe32(UINT32_MAX);
+    request.reserved = 0;
+
+    memcpy(batch + batch_len, &header, sizeof(header));
+    memcpy(batch + batch_len + sizeof(header), &request, sizeof(request));
+
+    ret_status = send_all(client->sock_fd, batch, batch_len + sizeof(header) + sizeof(request), &client->bytes_out);
+
+    if (!ret_status)
+        ret_status = frame_reply_read(client->sock_fd, &client->reader, FRAME_OP_READ, record, record_len,
+                                      &length, &client->bytes_in);
+
+    client->read_cursor += length;
+
+    if (ret_status < 0)
+    {
+        close(client->sock_fd);
+        client->sock_fd = -1;
+    }
+
+    return ret_status;
+}
+
+/**
+ * @brief   Sends "AESDCHAR_IOCSEEKTO:X,Y" command on its own connection and
+ *          reads the reply till the server closes the connection, the end of
+ *          the reply can not be told apart on a kept open connection.
+ *
+ * @param   client: Client sending the command.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+static int client_send_seekto(struct bench_client *client)
+{
+    struct reply_reader reader = client->reader;
+    char command[64];
+    int command_len;
+    int sock_fd;
+    int ret_status;
+
+    command_len = snprintf(command, sizeof(command), "AESDCHAR_IOCSEEKTO:%u,%u\n",
+                           bench_config.seek_cmd, bench_config.seek_offset);
+
+    sock_fd = bench_connect();
+
+    if (sock_fd < 0)
+        return -1;
+
+    // Buffer of the client is borrowed without the bytes kept for its connection
+    reader.data += client->reader.len;
+    reader.cap -= client->reader.len;
+    reader.len = 0;
+
+    ret_status = send_all(sock_fd, command, command_len, &client->bytes_out);
+
+    if (!ret_status)
+    {
+        shutdown(sock_fd, SHUT_WR);
+        ret_status = reply_read(sock_fd, &reader, NULL, 0, true, &client->bytes_in) > 0 ? 0 : -1;
+    }
+
+    close(sock_fd);
+
+    return ret_status;
+}
+
+/**
+ * @brief   Connects to the server.
+ *
+ * @param   void
+ *
+ * @return  Returns the connected socket on success and -1 on error.
+ */
+static int bench_connect(void)
+{
+    const struct sockaddr *addr = (const struct sockaddr *)&server_unix_addr;
+    socklen_t addr_len = sizeof(server_unix_addr);
+    int sock_fd;
+    int opt = 1;
+
+    if (bench_config.unix_path)
+        sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    else
+        sock_fd = socket(server_addr->ai_family, server_addr->ai_socktype | SOCK_CLOEXEC, server_addr->ai_protocol);
+
+    if (sock_fd < 0)
+    {
+        perror("Failed to create socket");
+        return -1;
+    }
+
+    if (!bench_config.unix_path)
+    {
+        addr = server_addr->ai_addr;
+        addr_len = server_addr->ai_addrlen;
+
+        // Connect returns at once, the SYN leaves with the first send
+        if (bench_config.low_latency &&
+            (setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) ||
+             setsockopt(sock_fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &opt, sizeof(opt))))
+        {
+            perror("Failed to set socket options");
+            close(sock_fd);
+            return -1;
+        }
+    }
+
+    if (connect(sock_fd, addr, addr_len))
+    {
+        perror("Failed to connect to server");
+        close(sock_fd);
+        return -1;
+    }
+
+    return sock_fd;
+}
+
+/**
+ * @brief   Sends all the bytes, continues after partial sends.
+ *
+ * @param   fd: Connected socket.
+ * @param   data: Bytes to be sent.
+ * @param   len: Number of bytes.
+ * @param   bytes_out: Incremented by the number of bytes sent.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+static int send_all(int fd, const char *data, size_t len, uint64_t *bytes_out)
+{
+    ssize_t ret_status;
+
+    while (len > 0)
+    {
+        ret_status = send(fd, data, len, MSG_NOSIGNAL);
+
+        if (ret_status < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("Error while sending data to the server");
+            return -1;
+        }
+
+        data += ret_status;
+        len -= ret_status;
+        *bytes_out += ret_status;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Receives exactly len bytes.
+ *
+ * @param   fd: Connected socket.
+ * @param   data: Buffer for the bytes.
+ * @param   len: Number of bytes.
+ * @param   bytes_in: Incremented by the number of bytes received.
+ *
+ * @return  Returns 0 on success and -1 on error or when the server closed
+ *          the connection.
+ */
+static int recv_all(int fd, void *data, size_t len, uint64_t *bytes_in)
+{
+    ssize_t ret_status;
+
+    while (len > 0)
+    {
+        ret_status = recv(fd, data, len, 0);
+
+        if (ret_status < 0 && errno == EINTR)
+            continue;
+
+        if (ret_status <= 0)
+        {
+            if (ret_status < 0)
+                perror("Error while getting data from the server");
+            else
+                printf("Server closed the connection before the reply was complete\n");
+
+            return -1;
+        }
+
+        data = (char *)data + ret_status;
+        len -= ret_status;
+        *bytes_in += ret_status;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Reads a binary reply, searching its payload for the record. Only
+ *          the tail which may hold the start of the record is kept while it
+ *          is not found.
+ *
+ * @param   fd: Connected socket.
+ * @param   reader: Buffer for the payload.
+ * @param   opcode: Opcode of the request.
+ * @param   needle: Record expected in the payload, NULL for none.
+ * @param   needle_len: Length of the record.
+ * @param   length: Set to the length of the payload when not NULL.
+ * @param   bytes_in: Incremented by the number of bytes received.
+ *
+ * @return  Returns 1 when the record is found (or there is no record), 0
+ *          when the payload does not carry it and -1 on error.
+ */
+static int frame_reply_read(int fd, struct reply_reader *reader, uint8_t opcode, const char *needle,
+                            size_t needle_len, uint32_t *length, uint64_t *bytes_in)
+{
+    struct frame_header header;
+    bool found = needle == NULL;
+    uint32_t left;
+    size_t len, keep;
+
+    if (recv_all(fd, &header, sizeof(header), bytes_in))
+        return -1;
+
+    if (header.opcode != opcode || header.status != FRAME_STATUS_OK)
+    {
+        printf("Server failed the request %u with status %u\n", header.opcode, header.status);
+        return -1;
+    }
+
+    reader->len = 0;
+
+    if (length)
+        *length = be32toh(header.length);
+
+    for (left = be32toh(header.length); left > 0; left -= len)
+    {
+        len = reader->cap - reader->len < left ? reader->cap - reader->len : left;
+
+        if (recv_all(fd, reader->data + reader->len, len, bytes_in))
+            return -1;
+
+        reader->len += len;
+
+        if (!found)
+            found = memmem(reader->data, reader->len, needle, needle_len) != NULL;
+
+        // Rest of the payload is not needed once the record is found
+        if (found)
+            keep = 0;
+        else
+            keep = reader->len < needle_len ? reader->len : needle_len - 1;
+
+        memmove(reader->data, reader->data + reader->len - keep, keep);
+        reader->len = keep;
+    }
+
+    return found ? 1 : 0;
+}
+
+/**
+ * @brief   Reads the reply from the server, searching it for the record. Only
+ *          the bytes after the record are kept once it is found, only the
+ *          tail which may hold the start of the record is kept otherwise.
+ *
+ * @param   fd: Connected socket.
+ * @param   reader: Bytes received on the socket and not yet matched.
+ * @param   needle: Record expected in the reply, NULL for none.
+ * @param   needle_len: Length of the record.
+ * @param   until_eof: Read till the server closes the connection, otherwise
+ *          returns as soon as the record is found.
+ * @param   bytes_in: Incremented by the number of bytes received.
+ *
+ * @return  Returns 1 when the record is found (or the reply is complete
+ *          when there is no record), 0 when the server closed the connection
+ *          without sending the record and -1 on error.
+ */
+static int reply_read(int fd, struct reply_reader *reader, const char *needle, size_t needle_len,
+                      bool until_eof, uint64_t *bytes_in)
+{
+    bool found = needle == NULL;
+    size_t keep;
+    ssize_t ret_status;
+    char *match;
+
+    while (true)
+    {
+        if (!found)
+        {
+            match = memmem(reader->data, reader->len, needle, needle_len);
+
+            if (match != NULL)
+            {
+                found = true;
+                keep = reader->data + reader->len - (match + needle_len);
+            }
+            else
+            {
+                keep = reader->len < needle_len ? reader->len : needle_len - 1;
+            }
+
+            memmove(reader->data, reader->data + reader->len - keep, keep);
+            reader->len = keep;
+
+            if (found && !until_eof)
+                return 1;
+        }
+
+        // Rest of a complete reply is not needed
+        if (found)
+            reader->len = 0;
+
+        ret_status = recv(fd, reader->data + reader->len, reader->cap - reader->len, 0);
+
+        if (ret_status < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("Error while getting data from the server");
+            return -1;
+        }
+
+        if (ret_status == 0)
+        {
+            if (until_eof)
+                return found ? 1 : 0;
+
+            printf("Server closed the connection before the reply was complete\n");
+            return -1;
+        }
+
+        reader->len += ret_status;
+        *bytes_in += ret_status;
+    }
+}
+
+/**
+ * @brief   Gets the monotonic time in nanoseconds.
+ *
+ * @param   void
+ *
+ * @return  Returns the current time.
+ */
+static uint64_t time_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    uint64_t latency_a = *(const uint64_t *)a;
+    uint64_t latency_b = *(const uint64_t *)b;
+
+    return (latency_a > latency_b) - (latency_a < latency_b);
+}
+
+/**
+ * @brief   Prints the totals of all the clients along with the throughput
+ *          and the latency percentiles of the records.
+ *
+ * @param   clients: All the clients.
+ * @param   elapsed_ns: Time taken by all the clients.
+ *
+ * @return  void
+ */
+static void print_report(struct bench_client *clients, uint64_t elapsed_ns)
+{
+    struct bench_client total;
+    uint64_t *latencies;
+    double elapsed_s = elapsed_ns / 1e9;
+    double quantiles[] = { 0.5, 0.99, 0.999 };
+    size_t index;
+    int count = 0;
+    int i, j;
+
+    memset(&total, 0, sizeof(total));
+
+    for (i = 0; i < bench_config.connections; i++)
+    {
+        total.records += clients[i].records;
+        total.seekto += clients[i].seekto;
+        total.errors += clients[i].errors;
+        total.mismatches += clients[i].mismatches;
+        total.bytes_out += clients[i].bytes_out;
+        total.bytes_in += clients[i].bytes_in;
+        total.num_latencies += clients[i].num_latencies;
+    }
+
+    printf("connections %d, records %" PRIu64 ", seekto %" PRIu64 ", errors %" PRIu64 ", mismatches %" PRIu64 "\n",
+           bench_config.connections, total.records, total.seekto, total.errors, total.mismatches);
+    printf("elapsed %.3f s, %.1f records/s, sent %.2f MB/s, received %.2f MB/s\n",
+           elapsed_s, (total.records + total.seekto) / elapsed_s,
+           total.bytes_out / elapsed_s / 1e6, total.bytes_in / elapsed_s / 1e6);
+
+    if (total.num_latencies == 0)
+        return;
+
+    latencies = malloc(total.num_latencies * sizeof(uint64_t));
+
+    if (latencies == NULL)
+    {
+        printf("Error while allocating memmory to latencies\n");
+        return;
+    }
+
+    for (i = 0; i < bench_config.connections; i++)
+    {
+        for (j = 0; j < clients[i].num_latencies; j++)
+            latencies[count++] = clients[i].latencies[j];
+    }
+
+    qsort(latencies, count, sizeof(uint64_t), compare_latency);
+
+    printf("latency us:");
+
+    for (i = 0; i < (int)(sizeof(quantiles) / sizeof(quantiles[0])); i++)
+    {
+        // Nearest rank percentile
+        index = (size_t)(quantiles[i] * count + 0.999999);
+        index = index ? index - 1 : 0;
+        printf(" p%g %.1f", quantiles[i] * 100, latencies[index] / 1e3);
+    }
+
+    printf(" max %.1f\n", latencies[count - 1] / 1e3);
+
+    free(latencies);
+}
+
+/**
+ * @brief   Parses the command line arguments into bench_config.
+ *
+ * @param   argc: Number of arguments.
+ * @param   argv: Arguments.
+ *
+ * @return  Returns 0 on success and -1 on invalid arguments.
+ */
+static int parse_args(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:u:c:n:s:r:S:O:kLb:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            bench_config.host = optarg;
+            break;
+
+        case 'p':
+            bench_config.port = optarg;
+            break;
+
+        case 'u':
+            if (strlen(optarg) >= sizeof(server_unix_addr.sun_path))
+                return -1;
+
+            bench_config.unix_path = optarg;
+            break;
+
+        case 'c':
+            bench_config.connections = atoi(optarg);
+
+            if (bench_config.connections <= 0)
+                return -1;
+            break;
+
+        case 'n':
+            bench_config.records = atoi(optarg);
+
+            if (bench_config.records <= 0)
+                return -1;
+            break;
+
+        case 's':
+            bench_config.record_size = atoi(optarg);
+
+            if (bench_config.record_size <= 0)
+                return -1;
+            break;
+
+        case 'r':
+            bench_config.rate = atoi(optarg);
+
+            if (bench_config.rate < 0)
+                return -1;
+            break;
+
+        case 'S':
+            bench_config.seek_every = atoi(optarg);
+
+            if (bench_config.seek_every < 0)
+                return -1;
+            break;
+
+        case 'O':
+            if (sscanf(optarg, "%u,%u", &bench_config.seek_cmd, &bench_config.seek_offset) != 2)
+                return -1;
+            break;
+
+        case 'k':
+            bench_config.keep_alive = true;
+            break;
+
+        case 'L':
+            bench_config.low_latency = true;
+            break;
+
+        case 'b':
+            bench_config.batch = atoi(optarg);
+
+            if (bench_config.batch <= 0)
+                return -1;
+            break;
+
+        default:
+            return -1;
+        }
+    }
+
+    if (optind < argc)
+        return -1;
+
+    // Seek command is part of the text protocol
+    if (bench_config.batch && bench_config.seek_every)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief   Prints out correct usage of application command when
+ *          user makes mistake.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+static void print_usage(void)
+{
+    printf("Usage: aesdbench [-h host] [-p port] [-u path] [-c connections] [-n records] [-s size]\n");
+    printf("\t\t [-r rate] [-S every] [-O X,Y] [-k] [-L] [-b batch]\n");
+    printf("\t-h: Server address, defaults to %s\n", DEFAULT_HOST);
+    printf("\t-p: Server port, defaults to %s\n", DEFAULT_PORT);
+    printf("\t-u: Connect to the Unix domain socket at path instead of host:port\n");
+    printf("\t-c: Number of concurrent clients, defaults to %d\n", DEFAULT_CONNECTIONS);
+    printf("\t-n: Records sent by every client, defaults to %d\n", DEFAULT_RECORDS);
+    printf("\t-s: Size of a record including '\\n', defaults to %d\n", DEFAULT_RECORD_SIZE);
+    printf("\t-r: Records per second sent by every client, 0 (default) for no limit\n");
+    printf("\t-S: Send AESDCHAR_IOCSEEKTO command in place of every Nth record\n");
+    printf("\t-O: X,Y arguments of the AESDCHAR_IOCSEEKTO command, defaults to 0,0\n");
+    printf("\t-k: Send all the records of a client on one connection\n");
+    printf("\t-L: Disable Nagle and send records in the SYN with TCP Fast Open\n");
+    printf("\t-b: Send records in batches of appends and a read over the binary\n");
+    printf("\t    protocol, on one connection per client (not with -S)\n");
+}
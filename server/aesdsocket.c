@@ -6,7 +6,7 @@
  *          the file "/var/tmp/aesdsocketdata". Then all the bytes from the file 
  *          are read and sent it back to the client.
  * 
- *          The timer handler will add time-stamp to "/var/tmp/aesdsocketdata"
+ *          The timer job will add time-stamp to "/var/tmp/aesdsocketdata"
  *          file every 10 seconds.
  *
  *          Note: Runs in daemon mode when -d is passed.
@@ -20,8 +20,96 @@
  * @change  String "AESDCHAR_IOCSEEKTO:X,Y" is processed when received on socket
  *          and subsequently ioctl operation is called.
  * @date    Apr 2nd 2023
+ *
+ * @change  Connection handling moved to connection.c. Added epoll mode (-m epoll)
+ *          where a fixed set of event loops serve all the connections, thread
+ *          per connection is kept as the default mode.
+ * @date    Oct 16th 2026
+ *
+ * @change  Added pool mode (-m pool) where accepted connections are queued to
+ *          a pre-spawned pool of work-stealing workers.
+ * @date    Oct 16th 2026
+ *
+ * @change  Replies are sent with sendfile(), -c selects the copy loop.
+ * @date    Oct 16th 2026
+ *
+ * @change  All the records received on a connection are processed, each one
+ *          followed by its reply. Connections stay open in keep-alive mode (-k).
+ * @date    Oct 16th 2026
+ *
+ * @change  Added incremental mode (-i), a reply to a record carries only the
+ *          bytes the client has not received yet on that connection.
+ * @date    Oct 16th 2026
+ *
+ * @change  Added sharded listening (-s), one SO_REUSEPORT listening socket
+ *          and pinned acceptor per shard, with configurable backlog (-b).
+ * @date    Oct 16th 2026
+ *
+ * @change  Added group commit (-g), records of all the connections are written
+ *          by a single committer thread in batches.
+ * @date    Oct 16th 2026
+ *
+ * @change  Added metrics (-M port), counters and latency histograms exported
+ *          in plain text on a loopback port.
+ * @date    Oct 16th 2026
+ *
+ * @change  Time-stamps are written by a timer thread instead of SIGALRM
+ *          handler, so blocking calls are no longer interrupted every 10
+ *          seconds. Metrics totals are logged every minute.
+ * @date    Oct 16th 2026
+ *
+ * @change  Connection logs are posted to per-thread rings and written by a
+ *          logger thread, filtered by level (-l).
+ * @date    Oct 16th 2026
+ *
+ * @change  Without the char device records are appended to a mapped and
+ *          preallocated data file without file_lock, replies are sent out of
+ *          the mapping and "AESDCHAR_IOCSEEKTO:X,Y" is served from its index.
+ * @date    Oct 16th 2026
+ *
+ * @change  Added the ring store (make RING_STORE=1), the last writes are kept
+ *          in the driver circular buffer linked in userspace and replies are
+ *          sent from a shared snapshot of it.
+ * @date    Oct 16th 2026
+ *
+ * @change  Replies from the char device that are not sent with sendfile(),
+ *          with -c or when it is not supported, and binary reads are sent out
+ *          of a reference counted snapshot shared by the clients replying at
+ *          the same generation, bumped by every write, instead of each client
+ *          reading the device. The copy loop is the fallback when a snapshot
+ *          can't be allocated.
+ * @date    Oct 16th 2026
+ *
+ * @change  "AESDCHAR_SUBSCRIBE[:X,Y]" subscribes the connection, appended
+ *          records are pushed to it on the commit broadcast of the store.
+ * @date    Oct 16th 2026
+ *
+ * @change  Added admission control, a cap on open connections (-C), budgets
+ *          on the receive buffers of a connection (-B) and of all of them
+ *          (-G), and read/write deadlines (-T) enforced by the timer thread.
+ * @date    Oct 16th 2026
+ *
+ * @change  Added per-client token buckets for the bytes received and replied
+ *          (-r), event loops serve the ready connections in deficit round
+ *          robin order with a quantum of bytes (-Q).
+ * @date    Oct 16th 2026
+ *
+ * @change  Added a Unix domain stream listener (-u path) for local clients,
+ *          served by the same connection handling as the TCP listeners.
+ * @date    Oct 16th 2026
+ *
+ * @change  Added low-latency mode (-L) with Nagle disabled, replies corked
+ *          until complete and TCP Fast Open on the listeners, socket buffer
+ *          sizes (-W) and busy polling (-P).
+ * @date    Oct 16th 2026
+ *
+ * @change  "AESDCHAR_BINARY" switches a connection to a length-prefixed
+ *          framed protocol (frame.h) with append, seek, read-range and stat
+ *          opcodes, appends are batched with a read in one round trip.
+ * @date    Oct 16th 2026
  *******************************************************************************/
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -31,27 +119,21 @@
 #include <unistd.h>
 #include <syslog.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <sys/queue.h>
 #include <pthread.h>
+#include <sched.h>
 #include <time.h>
-#include <sys/ioctl.h>
-
-#include "../aesd-char-driver/aesd_ioctl.h"
 
-#define USE_AESD_CHAR_DEVICE    1
-
-#define SERVER_PORT         (9000)
-#define MAX_BACKLOGS        (3)
-#define BUFFER_MAX_SIZE     (1024)
-
-#if USE_AESD_CHAR_DEVICE
-#define SOCK_DATA_FILE      ("/dev/aesdchar")
-#else
-#define SOCK_DATA_FILE      ("/var/tmp/aesdsocketdata")
-#endif
+#include "aesdsocket.h"
+#include "threadpool.h"
+#include "metrics.h"
+#include "logger.h"
 
 // Macro from https://raw.githubusercontent.com/freebsd/freebsd/stable/10/sys/sys/queue.h
 #define SLIST_FOREACH_SAFE(var, head, field, tvar)        \
@@ -61,80 +143,106 @@
 
 
 void *connection_handler(void *client_data);
-int sock_read(int client_fd, char **malloc_buffer, int *malloc_buffer_len);
-int file_read(int file_fd, char **malloc_buffer, int *malloc_buffer_len);
+void connection_task(void *client_data);
+int parse_args(int argc, char **argv);
+int parse_rates(char *arg);
+int listener_create(int backlog);
+int unix_listener_create(const char *path, int backlog);
+int serve_listeners(void);
+void *acceptor_thread(void *acceptor_data);
+int serve_threaded(int listen_fd);
+int serve_pooled(int listen_fd, struct threadpool *pool);
 void become_daemon();
 void print_usage();
 void exit_cleanup();
 void sig_int_term_handler();
 
 #if !USE_AESD_CHAR_DEVICE
-void sig_alarm_handler();
+void timestamp_job(void *arg);
 #endif
 
 
 struct client_node_t
 {
-    int sock_fd;
-    struct sockaddr_in addr;
-    socklen_t addr_len;
+    struct connection conn;
     pthread_t thread_id;
-    char *malloc_buffer;
     bool completed;
     SLIST_ENTRY(client_node_t) client_list;
 };
 
-// Singly linked list to keep track of all the threads created
 SLIST_HEAD(client_list_head_t, client_node_t);
-struct client_list_head_t client_list_head;
+
+struct acceptor_t
+{
+    pthread_t thread_id;
+    int listen_fd;
+    int cpu;
+    struct threadpool *pool;
+};
+
+struct server_config server_config = {
+    .run_as_daemon = false,
+    .mode = SERVER_MODE_THREAD,
+    .num_threads = 0,
+    .queue_depth = DEFAULT_QUEUE_DEPTH,
+    .zero_copy = true,
+    .keep_alive = false,
+    .incremental = false,
+    .sharded = false,
+    .num_shards = 1,
+    .backlog = 0,
+    .group_commit = false,
+    .commit_interval_us = 0,
+    .metrics_port = 0,
+    .max_connections = 0,
+    .conn_buffer_limit = 0,
+    .buffer_limit = 0,
+    .idle_timeout_ms = 0,
+    .rate_in = 0,
+    .rate_out = 0,
+    .quantum = DEFAULT_QUANTUM,
+    .unix_path = NULL,
+};
 
 int file_fd;
-pthread_mutex_t file_lock;
 
-int server_fd;
-int sig_exit_status = 0;
+int listen_fds[MAX_LISTENERS];
+int num_listen_fds = 0;
+int unix_listen_fd = -1;
+int exit_event_fd = -1;
+volatile sig_atomic_t sig_exit_status = 0;
 
 
 int main(int argc, char **argv)
 {
-    int client_fd;
-    struct sockaddr_in client_addr;
-    socklen_t client_addr_len;
-    int opt = 1;
     int ret_status = 0;
-    int run_as_daemon = 0;
-
-    memset(&client_addr, 0, sizeof(client_addr));
-    memset(&client_addr_len, 0, sizeof(client_addr_len));
 
-    if (argc <= 2)
-    {
-        if (argc == 2)
-        {
-            if (!strcmp(argv[1], "-d"))
-            {
-                run_as_daemon = 1;
-                printf("aesdsocket will run as daemon\n");
-            }
-            else
-            {
-                print_usage();
-                return -1;
-            }
-        }
-    }
-    else
+    if (parse_args(argc, argv))
     {
         print_usage();
         return -1;
     }
 
+    if (server_config.run_as_daemon)
+        printf("aesdsocket will run as daemon\n");
+
     openlog(NULL, 0, LOG_USER);
 
     signal(SIGINT, sig_int_term_handler);
     signal(SIGTERM, sig_int_term_handler);
 
-    file_fd = open(SOCK_DATA_FILE, O_CREAT | O_RDWR, S_IRWXU | S_IRWXG | S_IRWXO);
+    exit_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (exit_event_fd < 0)
+    {
+        perror("Failed to create exit event");
+        syslog(LOG_ERR, "Failed to create exit event: %s", strerror(errno));
+        exit_cleanup();
+        return -1;
+    }
+
+#if USE_AESD_CHAR_DEVICE
+    file_fd = open(SOCK_DATA_FILE, O_CREAT | O_RDWR | O_APPEND, S_IRWXU | S_IRWXG | S_IRWXO);
 
     if (file_fd < 0)
     {
@@ -143,111 +251,460 @@ int main(int argc, char **argv)
         exit_cleanup();
         return -1;
     }
+
+    // Every connection opens the device on its own
     close(file_fd);
+    file_fd = 0;
+
+    // Replies are shared out of snapshots of the device
+    if (store_snapshot_open(SOCK_DATA_FILE))
+    {
+        exit_cleanup();
+        return -1;
+    }
+#else
+    // Records are appended to the mapped data file or the in-process ring
+    if (store_open(SOCK_DATA_FILE))
+    {
+        exit_cleanup();
+        return -1;
+    }
+#endif
+
+    // Create one listening socket, or one per shard sharing the port
+    for (num_listen_fds = 0; num_listen_fds < server_config.num_shards; num_listen_fds++)
+    {
+        listen_fds[num_listen_fds] = listener_create(server_config.backlog);
+
+        if (listen_fds[num_listen_fds] < 0)
+        {
+            exit_cleanup();
+            return -1;
+        }
+    }
+
+    printf("Listening on port %d...\n", SERVER_PORT);
+    syslog(LOG_INFO, "Listening on port %d...", SERVER_PORT);
+
+    if (server_config.unix_path)
+    {
+        unix_listen_fd = unix_listener_create(server_config.unix_path, server_config.backlog);
 
-    ret_status = pthread_mutex_init(&file_lock, NULL);
+        if (unix_listen_fd < 0)
+        {
+            exit_cleanup();
+            return -1;
+        }
+
+        printf("Listening on %s...\n", server_config.unix_path);
+        syslog(LOG_INFO, "Listening on %s...", server_config.unix_path);
+    }
+
+    if (server_config.run_as_daemon)
+        become_daemon();
+
+    // Background threads are started after becoming daemon as threads do not survive fork
+    if (logger_start())
+    {
+        exit_cleanup();
+        return -1;
+    }
+
+    if (timer_start())
+    {
+        logger_stop();
+        exit_cleanup();
+        return -1;
+    }
+
+    if (admission_start())
+    {
+        timer_stop();
+        logger_stop();
+        exit_cleanup();
+        return -1;
+    }
+
+    if (server_config.group_commit && commit_start(server_config.commit_interval_us))
+    {
+        timer_stop();
+        logger_stop();
+        exit_cleanup();
+        return -1;
+    }
 
-    if (ret_status != 0)
+    if (server_config.metrics_port && metrics_start(server_config.metrics_port))
     {
-        perror("Mutex init has failed");
+        commit_stop();
+        timer_stop();
+        logger_stop();
         exit_cleanup();
         return -1;
     }
 
+#if !USE_AESD_CHAR_DEVICE
+    // Add time-stamp to the data file every 10 seconds
+    timer_schedule(TIMESTAMP_INTERVAL_MS, TIMESTAMP_INTERVAL_MS, timestamp_job, NULL);
+#endif
+
+    if (server_config.metrics_port)
+        timer_schedule(METRICS_FLUSH_INTERVAL_MS, METRICS_FLUSH_INTERVAL_MS, metrics_flush, NULL);
+
+    if (server_config.mode == SERVER_MODE_EPOLL)
+        ret_status = reactor_run(listen_fds, num_listen_fds, server_config.num_threads);
+    else
+        ret_status = serve_listeners();
+
+    timer_stop();
+
+    // Records of the connections served till exit are flushed
+    commit_stop();
+
+    metrics_stop();
+
+    // Records posted till now are written
+    logger_stop();
+
+    exit_cleanup();
+    
+    return ret_status;
+}
+
+/**
+ * @brief   Creates a listening socket on SERVER_PORT. SO_REUSEPORT is set so
+ *          that several listening sockets can share the port and the kernel
+ *          balances the incoming connections between them.
+ *
+ * @param   backlog: Maximum length of the queue of pending connections.
+ *
+ * @return  Returns the listening socket on success and -1 on error.
+ */
+int listener_create(int backlog)
+{
+    struct sockaddr_in server_addr;
+    int listen_fd;
+    int opt = 1;
+
     // Create server socket
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
 
     // Check if socket is created successfully
-    if (server_fd < 0)
+    if (listen_fd < 0)
     {
         perror("Failed to create socket");
         syslog(LOG_ERR, "Failed to create socket: %s", strerror(errno));
-        exit_cleanup();
         return -1;
     }
 
     // Set socket options for reusing address and port
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt)))
+    if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)))
     {
         perror("Failed to set socket options");
         syslog(LOG_ERR, "Failed to set socket options: %s", strerror(errno));
-        exit_cleanup();
+        close(listen_fd);
+        return -1;
+    }
+
+    // Inherited by the accepted sockets, so set before listening
+    if (sockopt_listener(listen_fd))
+    {
+        close(listen_fd);
         return -1;
     }
 
-    struct sockaddr_in server_addr;
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
     server_addr.sin_port = htons(SERVER_PORT);
 
-    if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)))
+    if (bind(listen_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)))
     {
         printf("Failed to bind on port %d: %s\n", SERVER_PORT, strerror(errno));
         syslog(LOG_ERR, "Failed to bind  on port %d: %s", SERVER_PORT, strerror(errno));
-        exit_cleanup();
+        close(listen_fd);
         return -1;
     }
 
-    if (listen(server_fd, MAX_BACKLOGS))
+    if (listen(listen_fd, backlog))
     {
         printf("Failed to start listening on port %d: %s\n", SERVER_PORT, strerror(errno));
         syslog(LOG_ERR, "Failed to start listening  on port %d: %s", SERVER_PORT, strerror(errno));
-        exit_cleanup();
+        close(listen_fd);
         return -1;
     }
 
-    printf("Listening on port %d...\n", SERVER_PORT);
-    syslog(LOG_INFO, "Listening on port %d...", SERVER_PORT);
+    return listen_fd;
+}
 
-    if (run_as_daemon)
-        become_daemon();
+/**
+ * @brief   Creates the Unix domain stream socket listening at the path, a
+ *          socket file left by a previous run is replaced.
+ *
+ * @param   path: Path of the socket file.
+ * @param   backlog: Listen backlog.
+ *
+ * @return  Returns the listening socket on success and -1 on error.
+ */
+int unix_listener_create(const char *path, int backlog)
+{
+    struct sockaddr_un server_addr;
+    int listen_fd;
 
-#if !USE_AESD_CHAR_DEVICE
-    signal(SIGALRM, sig_alarm_handler);
-    // Set to generate SIGALRM signal every 10 seconds
-    alarm(10);
-#endif
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (listen_fd < 0)
+    {
+        perror("Failed to create unix socket");
+        syslog(LOG_ERR, "Failed to create unix socket: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sun_family = AF_UNIX;
+    strncpy(server_addr.sun_path, path, sizeof(server_addr.sun_path) - 1);
+
+    unlink(path);
+
+    if (bind(listen_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)))
+    {
+        printf("Failed to bind on %s: %s\n", path, strerror(errno));
+        syslog(LOG_ERR, "Failed to bind on %s: %s", path, strerror(errno));
+        close(listen_fd);
+        return -1;
+    }
+
+    if (listen(listen_fd, backlog))
+    {
+        printf("Failed to start listening on %s: %s\n", path, strerror(errno));
+        syslog(LOG_ERR, "Failed to start listening on %s: %s", path, strerror(errno));
+        close(listen_fd);
+        unlink(path);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+/**
+ * @brief   Accepts the connections in thread or pool mode. A single listening
+ *          socket is served from the main thread, with shards every listening
+ *          socket gets its own acceptor thread pinned to a core.
+ *
+ * @param   void
+ *
+ * @return  Returns 0 on exit and -1 on error.
+ */
+int serve_listeners(void)
+{
+    struct acceptor_t acceptors[MAX_LISTENERS];
+    struct acceptor_t unix_acceptor;
+    struct threadpool pool;
+    struct threadpool *poolptr = NULL;
+    bool unix_started = false;
+    int started = 0;
+    int ret_status = 0;
+    int i;
+
+    if (server_config.mode == SERVER_MODE_POOL)
+    {
+        if (!threadpool_init(&pool, server_config.num_threads, server_config.queue_depth))
+        {
+            printf("Failed to start the worker pool\n");
+            syslog(LOG_ERR, "Failed to start the worker pool");
+            return -1;
+        }
+
+        poolptr = &pool;
+
+        printf("Serving connections from %d workers\n", server_config.num_threads);
+        syslog(LOG_INFO, "Serving connections from %d workers", server_config.num_threads);
+    }
+
+    // Local clients are accepted by a thread of their own, not pinned
+    if (unix_listen_fd >= 0)
+    {
+        unix_acceptor.listen_fd = unix_listen_fd;
+        unix_acceptor.cpu = -1;
+        unix_acceptor.pool = poolptr;
+
+        ret_status = pthread_create(&unix_acceptor.thread_id, NULL, acceptor_thread, &unix_acceptor);
+
+        if (ret_status != 0)
+        {
+            printf("Error while creating the acceptor thread: %s\n", strerror(ret_status));
+            syslog(LOG_ERR, "Error while creating the acceptor thread: %s", strerror(ret_status));
+
+            if (poolptr)
+                threadpool_destroy(poolptr);
+
+            return -1;
+        }
+
+        unix_started = true;
+    }
+
+    if (!server_config.sharded)
+    {
+        if (poolptr)
+            ret_status = serve_pooled(listen_fds[0], poolptr);
+        else
+            ret_status = serve_threaded(listen_fds[0]);
+    }
+    else
+    {
+        for (i = 0; i < num_listen_fds; i++)
+        {
+            acceptors[i].listen_fd = listen_fds[i];
+            acceptors[i].cpu = i;
+            acceptors[i].pool = poolptr;
+
+            ret_status = pthread_create(&acceptors[i].thread_id, NULL, acceptor_thread, &acceptors[i]);
+
+            if (ret_status != 0)
+            {
+                printf("Error while creating the acceptor thread: %s\n", strerror(ret_status));
+                syslog(LOG_ERR, "Error while creating the acceptor thread: %s", strerror(ret_status));
+                ret_status = -1;
+                break;
+            }
+
+            started++;
+        }
+
+        printf("Accepting connections on %d shards\n", started);
+        syslog(LOG_INFO, "Accepting connections on %d shards", started);
+
+        // Let the started acceptors exit if any of them failed to start
+        if (ret_status)
+            sig_int_term_handler();
+
+        for (i = 0; i < started; i++)
+            pthread_join(acceptors[i].thread_id, NULL);
+    }
+
+    if (unix_started)
+        pthread_join(unix_acceptor.thread_id, NULL);
+
+    // Queued connections are closed by the workers as exit is set
+    if (poolptr)
+        threadpool_destroy(poolptr);
 
+    return ret_status;
+}
+
+/**
+ * @brief   Acceptor thread of a shard or of the Unix domain listener. A shard
+ *          acceptor pins itself to a core, then the connections on the
+ *          listening socket are accepted.
+ *
+ * @param   acceptor_data: struct acceptor_t of this listener.
+ *
+ * @return  void
+ */
+void *acceptor_thread(void *acceptor_data)
+{
+    struct acceptor_t *acceptor = (struct acceptor_t *)acceptor_data;
+
+    if (acceptor->cpu >= 0)
+        pin_thread_to_cpu(acceptor->cpu);
+
+    if (acceptor->pool)
+        serve_pooled(acceptor->listen_fd, acceptor->pool);
+    else
+        serve_threaded(acceptor->listen_fd);
+
+    return NULL;
+}
+
+/**
+ * @brief   Sets the CPU affinity of the calling thread to a single core.
+ *
+ * @param   cpu: Index of the core, wrapped by the number of online cores.
+ *
+ * @return  void
+ */
+void pin_thread_to_cpu(int cpu)
+{
+    cpu_set_t cpuset;
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (num_cpus <= 0)
+        return;
+
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu % num_cpus, &cpuset);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset))
+        syslog(LOG_WARNING, "Failed to pin thread to cpu %ld", cpu % num_cpus);
+}
+
+/**
+ * @brief   Accepts the connections on the listening socket and creates a new
+ *          thread for each of them until exit is requested.
+ *
+ * @param   listen_fd: Listening socket.
+ *
+ * @return  Returns 0 on exit.
+ */
+int serve_threaded(int listen_fd)
+{
+    // Singly linked list to keep track of all the threads created
+    struct client_list_head_t client_list_head;
+    int client_fd;
+    int ret_status;
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len;
     struct client_node_t *client_node;
     struct client_node_t *tmp_client_node;
+
     SLIST_INIT(&client_list_head);
 
     while (true)
     {
         // Accept the incoming connection
-        client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_addr_len);
+        client_addr_len = sizeof(client_addr);
+        client_fd = accept(listen_fd, (struct sockaddr *)&client_addr, &client_addr_len);
 
         if (client_fd < 0)
         {
             if (sig_exit_status)
                 break;
             
-            perror("Failed to connect to client");
-            syslog(LOG_ERR, "Failed to connect to client: %s", strerror(errno));
+            LOGGER_POST(LOG_ERR, "Failed to connect to client", NULL, errno);
         }
         else
         {
             // Store client data in client node struct
             client_node = malloc(sizeof(struct client_node_t));
-            client_node->sock_fd = client_fd;
-            client_node->addr = client_addr;
-            client_node->addr_len = client_addr_len;
-            client_node->malloc_buffer = NULL;
+
+            if (client_node == NULL)
+            {
+                LOGGER_POST(LOG_ERR, "Error while allocating memmory to client node", NULL, 0);
+                close(client_fd);
+                continue;
+            }
+
+            if (connection_init(&client_node->conn, client_fd, &client_addr))
+            {
+                connection_close(&client_node->conn);
+                free(client_node);
+                continue;
+            }
+
             client_node->completed = 0;
             SLIST_INSERT_HEAD(&client_list_head, client_node, client_list);
 
             // Create a new thread for the connection
             ret_status = pthread_create(&client_node->thread_id, NULL, connection_handler, (void *)client_node);
 
-            if (ret_status < 0)
+            if (ret_status != 0)
             {
-                perror("Error while creating the thread");
-                syslog(LOG_ERR, "Error while creating the thread: %s\n", strerror(errno));
+                LOGGER_POST(LOG_ERR, "Error while creating the thread", &client_addr, ret_status);
 
                 // Delete client node data from list if fails
                 SLIST_REMOVE(&client_list_head, client_node, client_node_t, client_list);
 
-                close(client_node->sock_fd);
+                connection_close(&client_node->conn);
                 free(client_node);
             }
             
@@ -278,10 +735,68 @@ int main(int argc, char **argv)
         free(client_node);
     }
 
-    pthread_mutex_destroy(&file_lock);
+    return 0;
+}
+
+/**
+ * @brief   Accepts the connections on the listening socket and dispatches
+ *          them to the pre-spawned worker pool until exit is requested. The
+ *          connection is rejected when the queues of all the workers are full.
+ *          In keep-alive mode a connection occupies its worker until the
+ *          client closes it, so the pool has to be sized for the number of
+ *          concurrently open connections.
+ *
+ * @param   listen_fd: Listening socket.
+ * @param   pool: Worker pool serving the connections.
+ *
+ * @return  Returns 0 on exit.
+ */
+int serve_pooled(int listen_fd, struct threadpool *pool)
+{
+    int client_fd;
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len;
+    struct connection *conn;
+
+    while (true)
+    {
+        // Accept the incoming connection
+        client_addr_len = sizeof(client_addr);
+        client_fd = accept(listen_fd, (struct sockaddr *)&client_addr, &client_addr_len);
+
+        if (client_fd < 0)
+        {
+            if (sig_exit_status)
+                break;
+
+            LOGGER_POST(LOG_ERR, "Failed to connect to client", NULL, errno);
+            continue;
+        }
+
+        conn = malloc(sizeof(struct connection));
+
+        if (conn == NULL)
+        {
+            LOGGER_POST(LOG_ERR, "Error while allocating memmory to connection", NULL, 0);
+            close(client_fd);
+            continue;
+        }
+
+        if (connection_init(conn, client_fd, &client_addr))
+        {
+            connection_close(conn);
+            free(conn);
+            continue;
+        }
+
+        if (!threadpool_submit(pool, connection_task, conn))
+        {
+            LOGGER_POST(LOG_WARNING, "Worker queues are full, rejecting", &conn->addr, 0);
+            connection_close(conn);
+            free(conn);
+        }
+    }
 
-    exit_cleanup();
-    
     return 0;
 }
 
@@ -289,8 +804,9 @@ int main(int argc, char **argv)
  * @brief   Receives data from client until '\n' character is found and then 
  *          writes the received data to the file "/var/tmp/aesdsocketdata". 
  *          Then all the bytes from the file are read and sent it back to the
- *          client. After sending data to the client, closes the connection
- *          and exits the thread execution.
+ *          client. Records received along with the first one (or all the
+ *          records in keep-alive mode) are served the same way, then closes
+ *          the connection and exits the thread execution.
  *
  * @param   client_data: Contains all the info related to the client such as
  *          client fd, addr, thread completed status etc.
@@ -301,189 +817,272 @@ void *connection_handler(void *client_data)
 {
     struct client_node_t *client_node = (struct client_node_t *)client_data;
 
-    char client_addr_str[INET_ADDRSTRLEN];
+    connection_serve(&client_node->conn);
 
-    // Get ip address of client in string
-    inet_ntop(AF_INET, &client_node->addr.sin_addr, client_addr_str, sizeof(client_addr_str));
+    connection_close(&client_node->conn);
 
-    printf("Accepted connection from %s\n", client_addr_str);
-    syslog(LOG_INFO, "Accepted connection from %s", client_addr_str);
+    client_node->completed = 1;
 
-    int malloc_buffer_len = 0;
-    int ret_status;
-    char *write_cmd;
-    char *write_offset;
-    struct aesd_seekto seekto;
+    return NULL;
+}
+
+/**
+ * @brief   Worker pool task serving one connection, same as
+ *          connection_handler but the connection is freed once done.
+ *
+ * @param   client_data: struct connection allocated by serve_pooled.
+ *
+ * @return  void
+ */
+void connection_task(void *client_data)
+{
+    struct connection *conn = (struct connection *)client_data;
 
+    connection_serve(conn);
+
+    connection_close(conn);
+    free(conn);
+}
+
+/**
+ * @brief   Parses the command line arguments into server_config.
+ *
+ * @param   argc: Number of arguments.
+ * @param   argv: Arguments.
+ *
+ * @return  Returns 0 on success and -1 on invalid arguments.
+ */
+int parse_args(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "dm:t:q:ckis:b:g:M:l:C:B:G:T:r:Q:u:LW:P:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            server_config.run_as_daemon = true;
+            break;
+
+        case 'm':
+            if (!strcmp(optarg, "thread"))
+                server_config.mode = SERVER_MODE_THREAD;
+            else if (!strcmp(optarg, "epoll"))
+                server_config.mode = SERVER_MODE_EPOLL;
+            else if (!strcmp(optarg, "pool"))
+                server_config.mode = SERVER_MODE_POOL;
+            else
+                return -1;
+            break;
+
+        case 't':
+            server_config.num_threads = atoi(optarg);
+
+            if (server_config.num_threads <= 0)
+                return -1;
+            break;
+
+        case 'q':
+            server_config.queue_depth = atoi(optarg);
+
+            if (server_config.queue_depth <= 0)
+                return -1;
+            break;
+
+        case 'c':
+            server_config.zero_copy = false;
 #if !USE_AESD_CHAR_DEVICE
-        pthread_mutex_lock(&file_lock);
+            printf("Option -c has no effect, replies are sent from the store\n");
 #endif
+            break;
 
-    file_fd = open(SOCK_DATA_FILE, O_RDWR);
+        case 'k':
+            server_config.keep_alive = true;
+            break;
 
-    while (true && !sig_exit_status) // loop for a read session until \n is found
-    {
-        ret_status = sock_read(client_node->sock_fd, &client_node->malloc_buffer, &malloc_buffer_len);
+        case 'i':
+            server_config.keep_alive = true;
+            server_config.incremental = true;
+            break;
 
-        if (ret_status == 0)
-            continue;
+        case 's':
+            server_config.sharded = true;
+            server_config.num_shards = atoi(optarg);
 
-        if (ret_status < 0)
-            goto close_client;
+            if (server_config.num_shards < 0)
+                return -1;
+            break;
 
-        // Check if received string contains command
-        if (!memcmp(client_node->malloc_buffer, "AESDCHAR_IOCSEEKTO:", 19))
-        {
-            // Get position of X which should be just after ':'
-            write_cmd = memchr(client_node->malloc_buffer, ':', malloc_buffer_len);
-            
-            if ((client_node->malloc_buffer - write_cmd) >= (malloc_buffer_len - 1))
-                goto close_client;
+        case 'b':
+            server_config.backlog = atoi(optarg);
 
-            // Get position of Y which should be just after ','
-            write_offset = memchr(client_node->malloc_buffer, ',', malloc_buffer_len);
+            if (server_config.backlog <= 0)
+                return -1;
+            break;
 
-            if ((client_node->malloc_buffer - write_offset) >= (malloc_buffer_len - 1))
-                goto close_client;
+        case 'g':
+            server_config.group_commit = true;
+            server_config.commit_interval_us = atoi(optarg);
 
-            write_cmd++;
+            if (server_config.commit_interval_us < 0)
+                return -1;
+            break;
 
-            if(write_cmd == write_offset)
-                goto close_client;
+        case 'M':
+            server_config.metrics_port = atoi(optarg);
 
-            /* Convert character array starting from 'write_cmd' address to 'write_offset' 
-            to string which ends with null character */
-            *write_offset = '\0';
+            if (server_config.metrics_port <= 0 || server_config.metrics_port > 65535)
+                return -1;
+            break;
 
-            seekto.write_cmd = atoi(write_cmd);
+        case 'l':
+            if (!strcmp(optarg, "err"))
+                logger_max_level = LOG_ERR;
+            else if (!strcmp(optarg, "warning"))
+                logger_max_level = LOG_WARNING;
+            else if (!strcmp(optarg, "info"))
+                logger_max_level = LOG_INFO;
+            else if (!strcmp(optarg, "debug"))
+                logger_max_level = LOG_DEBUG;
+            else
+                return -1;
+            break;
 
-            write_offset++;
+        case 'C':
+            server_config.max_connections = atoi(optarg);
 
-            if(write_offset == client_node->malloc_buffer + (malloc_buffer_len - 1))
-                goto close_client;
+            if (server_config.max_connections < 0)
+                return -1;
+            break;
 
-            /* Convert character array starting from 'write_offset' address to end of buffer
-            to string which ends with null character */
-            client_node->malloc_buffer[malloc_buffer_len - 1] = '\0';
+        case 'B':
+            server_config.conn_buffer_limit = strtoul(optarg, NULL, 10);
 
-            seekto.write_cmd_offset = atoi(write_offset);
+            // Has to fit the first buffer of a connection
+            if (server_config.conn_buffer_limit < RX_BUFFER_INIT_SIZE)
+                return -1;
+            break;
 
-            if (ioctl(file_fd, AESDCHAR_IOCSEEKTO, &seekto))
-                perror("IOCTL Error");
+        case 'G':
+            server_config.buffer_limit = strtoul(optarg, NULL, 10);
 
-        }
-        else
-        {
-            ret_status = write(file_fd, client_node->malloc_buffer, malloc_buffer_len);
-        }
+            if (server_config.buffer_limit < RX_BUFFER_INIT_SIZE)
+                return -1;
+            break;
 
-        if (ret_status < 0)
-        {
-            perror("Error while writing to the file");
-            syslog(LOG_ERR, "Error while writing to the file: %s", strerror(errno));
-            goto close_client;
-        }
+        case 'T':
+            if (atoi(optarg) <= 0)
+                return -1;
 
-        break;
-    }
+            server_config.idle_timeout_ms = atoi(optarg);
+            break;
 
-    if (sig_exit_status)
-        goto close_client;
+        case 'r':
+            if (parse_rates(optarg))
+                return -1;
+            break;
 
-    char buffer[BUFFER_MAX_SIZE];
+        case 'Q':
+            server_config.quantum = strtol(optarg, NULL, 10);
 
-    while(1)
-    {
-        ret_status = read(file_fd, buffer, BUFFER_MAX_SIZE);
+            if (server_config.quantum <= 0)
+                return -1;
+            break;
 
-        if (ret_status <= 0)
+        case 'u':
+            if (strlen(optarg) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+                return -1;
+
+            server_config.unix_path = optarg;
             break;
 
-        write(client_node->sock_fd, buffer, ret_status);
-    }
+        case 'L':
+            server_config.low_latency = true;
+            break;
 
-close_client:
-    close(file_fd);
+        case 'W':
+            server_config.sock_buf_size = atoi(optarg);
 
-#if !USE_AESD_CHAR_DEVICE
-    pthread_mutex_unlock(&file_lock);
-#endif
+            if (server_config.sock_buf_size <= 0)
+                return -1;
+            break;
+
+        case 'P':
+            server_config.busy_poll_us = atoi(optarg);
+
+            if (server_config.busy_poll_us <= 0)
+                return -1;
+            break;
 
-    if (client_node->malloc_buffer)
+        default:
+            return -1;
+        }
+    }
+
+    if (optind < argc)
+        return -1;
+
+    // Default to one event loop or worker per online core
+    if (server_config.num_threads == 0)
     {
-        free(client_node->malloc_buffer);
-        client_node->malloc_buffer = NULL;
+        server_config.num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (server_config.num_threads <= 0)
+            server_config.num_threads = 1;
     }
 
-    if (client_node->sock_fd > 0)
+    if (server_config.sharded)
     {
-        close(client_node->sock_fd);
-        client_node->sock_fd = 0;
-        printf("Connection Closed from %s\n", client_addr_str);
-        syslog(LOG_INFO, "Closed connection from %s", client_addr_str);
+        // Default to one shard per online core
+        if (server_config.num_shards == 0)
+            server_config.num_shards = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (server_config.num_shards <= 0)
+            server_config.num_shards = 1;
+
+        if (server_config.num_shards > MAX_LISTENERS)
+            server_config.num_shards = MAX_LISTENERS;
+
+        // Every event loop serves one listening socket
+        if (server_config.mode == SERVER_MODE_EPOLL && server_config.num_shards > server_config.num_threads)
+            server_config.num_shards = server_config.num_threads;
+
+        if (server_config.backlog == 0)
+            server_config.backlog = SOMAXCONN;
     }
 
-    client_node->completed = 1;
+    if (server_config.backlog == 0)
+        server_config.backlog = MAX_BACKLOGS;
 
-    return NULL;
+    return 0;
 }
 
 /**
- * @brief   Reads bytes from the client socket and copies that into the 
- *          malloc buffer.
+ * @brief   Parses "in[,out]" rates of the -r option, the reply rate defaults
+ *          to the receive rate. A rate of 0 is not limited.
  *
- * @param   client_fd: Client file descriptor
- * @param   malloc_buffer: Dynamically allocated, all bytes read from 
- *          the socket are copied to this.
- * @param   malloc_buffer_len: Updated to the size of malloc buffer.
+ * @param   arg: Argument of the option.
  *
- * @return  Returns 1 when \n is encounterd in the read buffer and returns
- *          0 when not found. Returns < 0 on error. 
+ * @return  Returns 0 on success and -1 on invalid rates.
  */
-int sock_read(int client_fd, char **malloc_buffer, int *malloc_buffer_len)
+int parse_rates(char *arg)
 {
-    int bytes_count;
-    char buffer[BUFFER_MAX_SIZE];
-    int buffer_len = read(client_fd, buffer, BUFFER_MAX_SIZE);
+    char *end;
 
-    if (buffer_len <= 0)
-    {
-        perror("Error while getting data from the client");
-        syslog(LOG_ERR, "Error while getting data from the client: %s\n", strerror(errno));
-        return -1;
-    }
-
-    int index = 0;
+    server_config.rate_in = strtoull(arg, &end, 10);
+    server_config.rate_out = server_config.rate_in;
 
-    // Find the delimeter '\n' in the received buffer
-    for (index = 0; index < buffer_len && buffer[index] != '\n'; index++);
+    if (*end == ',')
+        server_config.rate_out = strtoull(end + 1, &end, 10);
 
-    // Adjust buffer length to be allocated
-    if (index < buffer_len)
-        bytes_count = index + 1;
-    else
-        bytes_count = buffer_len;
-
-    if (*malloc_buffer)
-        *malloc_buffer = (char *)realloc(*malloc_buffer, *malloc_buffer_len + bytes_count);
-    else
-        *malloc_buffer = (char *)malloc(sizeof(char) * bytes_count);
-        
-    if (*malloc_buffer == NULL)
-    {
-        printf("Error while allocating memmory to buffer\n");
-        syslog(LOG_ERR, "Error while allocating memmory to buffer");
+    if (end == arg || *end != '\0')
         return -1;
-    }
 
-    // copy data including \n and update malloc buffer length
-    memcpy(*malloc_buffer + *malloc_buffer_len, buffer, bytes_count);
-    *malloc_buffer_len += bytes_count;
+    // Refill of a second worth of tokens has to fit in 64 bits
+    if (server_config.rate_in > UINT32_MAX || server_config.rate_out > UINT32_MAX)
+        return -1;
 
-    if (index < buffer_len)
-        return 1;
-    else
-        return 0;
+    return 0;
 }
 
 /**
@@ -499,10 +1098,27 @@ void exit_cleanup(void)
     if (file_fd > 0)
         close(file_fd);
 
-    if (server_fd > 0)
-        close(server_fd);
+    for (int i = 0; i < num_listen_fds; i++)
+        close(listen_fds[i]);
 
+    if (unix_listen_fd >= 0)
+    {
+        close(unix_listen_fd);
+        unlink(server_config.unix_path);
+    }
+
+    if (exit_event_fd >= 0)
+        close(exit_event_fd);
+
+#if USE_AESD_CHAR_DEVICE
+    store_snapshot_close();
+#else
+    store_close();
+#endif
+
+#if !USE_AESD_RING_STORE
     remove(SOCK_DATA_FILE);
+#endif
 
     closelog();
 }
@@ -519,39 +1135,50 @@ void sig_int_term_handler(void)
     printf("Exiting...\n");
     syslog(LOG_INFO, "Exiting...\n");
     sig_exit_status = 1;
-    close(server_fd);
+
+    // Shutdown wakes up the acceptors blocked in accept on any thread
+    for (int i = 0; i < num_listen_fds; i++)
+        shutdown(listen_fds[i], SHUT_RDWR);
+
+    if (unix_listen_fd >= 0)
+        shutdown(unix_listen_fd, SHUT_RDWR);
+
+    // Wake up the event loops blocked in epoll_wait
+    if (exit_event_fd >= 0)
+        eventfd_write(exit_event_fd, 1);
 }
 
 /**
- * @brief   Signal handler function for SIGALRM, will be triggered
- *          every 10 seconds. Logs the time-stamp data to the 
- *          /var/tmp/aesdsocketdata file.
+ * @brief   Timer job, will be run every 10 seconds by the timer thread. Logs
+ *          the time-stamp data to the /var/tmp/aesdsocketdata file as a record
+ *          of its own.
  *
- * @param   void
+ * @param   arg: Unused.
  *
  * @return  void
  */
 #if !USE_AESD_CHAR_DEVICE
-void sig_alarm_handler(void)
+void timestamp_job(void *arg)
 {
     time_t raw_time;
-    struct tm *time_st;
+    struct tm time_st;
     char buffer[100];
     char timestamp[80] = "timestamp:time\n";
+    struct iovec iov;
 
     time(&raw_time);
 
-    time_st = localtime(&raw_time);
+    localtime_r(&raw_time, &time_st);
 
-    strftime(timestamp,80,"%x - %H:%M:%S", time_st);
+    strftime(timestamp, 80, "%x - %H:%M:%S", &time_st);
 
-    sprintf(buffer, "timestamp:%s\n", timestamp);
+    snprintf(buffer, sizeof(buffer), "timestamp:%s\n", timestamp);
 
-    pthread_mutex_lock(&file_lock);
-    write(file_fd, buffer, strlen(buffer));
-    pthread_mutex_unlock(&file_lock);
+    iov.iov_base = buffer;
+    iov.iov_len = strlen(buffer);
 
-    alarm(10);
+    if (store_append(&iov, 1))
+        LOGGER_POST(LOG_ERR, "Error while writing time-stamp to the file", NULL, errno);
 }
 #endif
 
@@ -565,10 +1192,40 @@ void sig_alarm_handler(void)
  */
 void print_usage(void)
 {
-    printf("Total number of arguements should 1 or less\n");
-    printf("The order of arguements should be:\n");
-    printf("\t1) To run the process as daemon\n");
-    printf("Usgae: aesdsocket -d\n");
+    printf("Usgae: aesdsocket [-d] [-m thread|epoll|pool] [-t threads] [-q depth] [-c] [-k] [-i]\n");
+    printf("\t\t  [-s shards] [-b backlog] [-g usec] [-M port]\n");
+    printf("\t\t  [-l err|warning|info|debug] [-C connections] [-B bytes] [-G bytes] [-T msec]\n");
+    printf("\t\t  [-r in[,out]] [-Q bytes] [-u path] [-L] [-W bytes] [-P usec]\n");
+    printf("\t-d: To run the process as daemon\n");
+    printf("\t-m: Connection handling mode, a thread per connection (default),\n");
+    printf("\t    edge-triggered epoll event loops or a pool of worker threads\n");
+    printf("\t-t: Number of event loops or workers, defaults to number of cores\n");
+    printf("\t-q: Maximum connections queued per worker, defaults to %d\n", DEFAULT_QUEUE_DEPTH);
+    printf("\t-c: Send replies out of a shared snapshot of the char device, or with\n");
+    printf("\t    read/write copy loop when it can't be allocated, instead of sendfile\n");
+    printf("\t-k: Keep connections open for pipelined records until client closes\n");
+    printf("\t-i: Keep connections open and reply only the bytes not yet sent\n");
+    printf("\t-s: Listening sockets sharing the port, each with an acceptor thread\n");
+    printf("\t    (event loop in epoll mode) pinned to a core, 0 for one per core\n");
+    printf("\t-b: Listen backlog, defaults to %d or SOMAXCONN with shards\n", MAX_BACKLOGS);
+    printf("\t-g: Group commit records of all clients with one write per flush,\n");
+    printf("\t    waiting usec for more records after the first one\n");
+    printf("\t-M: Export counters and latency histograms on 127.0.0.1:port\n");
+    printf("\t-l: Highest level of the connection logs written, defaults to info\n");
+    printf("\t-C: Maximum open connections, the ones above are closed on accept\n");
+    printf("\t-B: Receive buffer budget of a connection, bytes (at least %d)\n", RX_BUFFER_INIT_SIZE);
+    printf("\t-G: Receive buffer budget of all the connections, bytes, a connection\n");
+    printf("\t    whose buffer would grow past -B or -G is closed\n");
+    printf("\t-T: Close connections making no read or write progress for msec\n");
+    printf("\t-r: Bytes per second received from and replied to a client address,\n");
+    printf("\t    shared by its connections\n");
+    printf("\t-Q: Bytes an event loop serves a connection per round, defaults to %d\n", DEFAULT_QUANTUM);
+    printf("\t-u: Also listen on a Unix domain socket at path, local clients share\n");
+    printf("\t    one address for -r\n");
+    printf("\t-L: Low-latency mode, no Nagle delay, replies corked until complete\n");
+    printf("\t    and TCP Fast Open on the listeners\n");
+    printf("\t-W: Send and receive buffer size of the TCP sockets, bytes\n");
+    printf("\t-P: Busy poll the device queue for usec while waiting for data\n");
 }
 
 /**
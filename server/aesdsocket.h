@@ -0,0 +1,282 @@
+/*******************************************************************************
+ * @file    aesdsocket.h
+ * @brief   Definitions shared between the aesdsocket main program, the
+ *          connection handling code and the epoll event loop.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#ifndef AESDSOCKET_H
+#define AESDSOCKET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef USE_AESD_CHAR_DEVICE
+#define USE_AESD_CHAR_DEVICE    1
+#endif
+
+// Ring store keeps the last writes in process memory instead of the char device
+#ifndef USE_AESD_RING_STORE
+#define USE_AESD_RING_STORE     0
+#endif
+
+#if USE_AESD_RING_STORE && USE_AESD_CHAR_DEVICE
+#error "Ring store replaces the char device, build with USE_AESD_CHAR_DEVICE=0"
+#endif
+
+#if USE_AESD_RING_STORE
+#include "../aesd-char-driver/aesd-circular-buffer.h"
+#endif
+
+#define SERVER_PORT         (9000)
+#define MAX_BACKLOGS        (3)
+#define MAX_LISTENERS       (256)
+#define BUFFER_MAX_SIZE     (1024)
+#define MAX_EPOLL_EVENTS    (64)
+#define DEFAULT_QUEUE_DEPTH (128)
+#define REPLY_CHUNK_SIZE    (64 * 1024)
+#define RX_BUFFER_INIT_SIZE (4 * BUFFER_MAX_SIZE)
+#define DEFAULT_QUANTUM     (REPLY_CHUNK_SIZE)
+#define TIMESTAMP_INTERVAL_MS       (10 * 1000)
+#define METRICS_FLUSH_INTERVAL_MS   (60 * 1000)
+
+#if USE_AESD_CHAR_DEVICE
+#define SOCK_DATA_FILE      ("/dev/aesdchar")
+#else
+#define SOCK_DATA_FILE      ("/var/tmp/aesdsocketdata")
+#endif
+
+// Return values of the connection read/write handlers
+#define CONN_CLOSE          (-1)
+#define CONN_AGAIN          (0)
+#define CONN_DONE           (1)
+#define CONN_COMMIT         (2)     // Waiting for the group commit of the record
+#define CONN_THROTTLED      (3)     // Rate limited until resume_ns of the connection
+
+enum server_mode
+{
+    SERVER_MODE_THREAD = 0,     // One thread per accepted connection
+    SERVER_MODE_EPOLL,          // Fixed set of edge-triggered epoll loops
+    SERVER_MODE_POOL,           // Pre-spawned pool of work-stealing workers
+};
+
+// Directions of the per-client rate limits
+enum rate_dir
+{
+    RATE_IN = 0,        // Bytes received from the client
+    RATE_OUT,           // Bytes replied to the client
+    NUM_RATE_DIRS,
+};
+
+struct server_config
+{
+    bool run_as_daemon;
+    enum server_mode mode;
+    int num_threads;
+    int queue_depth;
+    bool zero_copy;
+    bool keep_alive;
+    bool incremental;
+    bool sharded;
+    int num_shards;
+    int backlog;
+    bool group_commit;
+    int commit_interval_us;
+    int metrics_port;
+    int max_connections;            // 0 for no cap
+    size_t conn_buffer_limit;       // Receive buffer budget of a connection, 0 for none
+    size_t buffer_limit;            // Receive buffer budget of all the connections, 0 for none
+    unsigned int idle_timeout_ms;   // 0 for no read/write deadlines
+    uint64_t rate_in;               // Bytes per second a client may send, 0 for no limit
+    uint64_t rate_out;              // Bytes per second replied to a client, 0 for no limit
+    int64_t quantum;                // Bytes served per round by an event loop
+    const char *unix_path;          // Path of the Unix domain listener, NULL for none
+    bool low_latency;               // No Nagle, corked replies and Fast Open
+    int sock_buf_size;              // SO_SNDBUF and SO_RCVBUF of TCP sockets, 0 for default
+    int busy_poll_us;               // SO_BUSY_POLL of accepted sockets, 0 for none
+};
+
+/**
+ * Bytes received from the client. Records between start and the last '\n'
+ * are yet to be processed, bytes after it belong to a partial record.
+ */
+struct rx_buffer
+{
+    char *data;
+    size_t cap;
+    size_t start;       // Start of the oldest unprocessed record
+    size_t len;         // End of the received bytes
+    size_t scanned;     // Bytes before this offset have no '\n'
+};
+
+/**
+ * State of a single client connection. The same state machine is driven by
+ * a dedicated thread on a blocking socket or by an epoll loop on a
+ * non-blocking one.
+ */
+struct connection
+{
+    int sock_fd;
+    int file_fd;
+    struct sockaddr_in addr;
+
+    struct rx_buffer rx;
+
+    // Timestamps for the latency metrics, 0 when not measured
+    uint64_t accept_ns;
+    uint64_t reply_start_ns;
+
+    // Record queued for the group commit, reply waits till it is written
+    bool commit_pending;
+    uint64_t commit_seq;
+    struct commit_ticket *commit_ticket;    // Created on the first record queued
+    bool commit_queued;     // On the commit wait queue of an event loop
+    STAILQ_ENTRY(connection) commit_entries;
+
+    // Snapshot the reply is sent from, NULL when none is held
+    struct store_snapshot *snapshot;
+
+    // Offset of the first byte of the data file not yet sent to the client
+    off_t read_cursor;
+
+    // Subscribers get the records pushed as they are appended
+    bool subscribed;
+    bool subscriber_listed;     // On the subscriber list of an event loop
+    int notify_fd;              // Signalled on append when served by a thread
+    LIST_ENTRY(connection) subscriber_entries;
+
+    // Frames are received instead of '\n' terminated records once negotiated
+    bool binary;
+
+    // Reply streaming state, bytes are sent starting from reply_offset
+    bool reply_pending;
+    off_t reply_offset;
+    off_t reply_end;            // Binary reply stops here, a text one at the end of the data
+    char reply_buffer[BUFFER_MAX_SIZE];
+    int reply_len;
+    int reply_sent;
+    bool corked;                // TCP_CORK set until the reply is complete
+
+    // Admission state, the last progress is read by the idle sweep
+    bool admitted;
+    atomic_uint_fast64_t active_ms;     // 0 when no deadline runs
+    LIST_ENTRY(connection) admitted_entries;
+
+    // Rate limits shared by the connections of the client address
+    struct rate_client *rate_client;
+    uint64_t resume_ns;         // Throttled until this time, 0 when not throttled
+
+    // Deficit round robin of the event loops, quantum is added every round
+    int64_t deficit;
+    bool ready_queued;          // On the ready queue of an event loop
+    bool throttle_listed;       // On the throttled list of an event loop
+    STAILQ_ENTRY(connection) ready_entries;
+    LIST_ENTRY(connection) throttled_entries;
+
+    LIST_ENTRY(connection) entries;
+};
+
+/**
+ * Contents of the char device or the ring store at a generation, bumped on
+ * every write. Shared by the connections replying at that generation and
+ * freed once the last reference is released.
+ */
+struct store_snapshot
+{
+    atomic_int refs;
+    uint64_t generation;
+    size_t size;
+#if USE_AESD_RING_STORE
+    // Records copied end to end from the oldest one
+    uint64_t stream_end;        // Bytes ever appended to the ring, at the end of data
+    uint32_t num_records;
+    size_t record_ends[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+#endif
+    char data[];
+};
+
+typedef void (*timer_func_t)(void *arg);
+
+extern struct server_config server_config;
+extern volatile sig_atomic_t sig_exit_status;
+extern int listen_fds[MAX_LISTENERS];
+extern int num_listen_fds;
+extern int unix_listen_fd;
+extern int exit_event_fd;
+
+int connection_init(struct connection *conn, int sock_fd, struct sockaddr_in *addr);
+int connection_read(struct connection *conn);
+bool connection_has_record(struct connection *conn);
+void connection_serve(struct connection *conn);
+int connection_write(struct connection *conn);
+int connection_push(struct connection *conn);
+int connection_discard(struct connection *conn);
+void connection_close(struct connection *conn);
+int sock_read(int client_fd, struct rx_buffer *rx);
+
+int commit_start(int interval_us);
+void commit_stop(void);
+struct commit_ticket *commit_ticket_new(void);
+void commit_ticket_put(struct commit_ticket *ticket);
+int commit_submit(struct commit_ticket *ticket, const char *data, size_t len, uint64_t *seq);
+int commit_status(struct commit_ticket *ticket, uint64_t seq);
+void commit_wait(uint64_t seq);
+int commit_add_notify(int event_fd);
+void commit_remove_notify(int event_fd);
+
+int admission_start(void);
+int admission_open(struct connection *conn);
+void admission_close(struct connection *conn);
+int admission_charge(size_t cap, size_t *new_cap, size_t required);
+void admission_release(size_t cap);
+void admission_touch(struct connection *conn);
+void admission_idle(struct connection *conn);
+
+uint64_t ratelimit_now(void);
+struct rate_client *ratelimit_get(const struct sockaddr_in *addr);
+void ratelimit_put(struct rate_client *client);
+void ratelimit_charge(struct rate_client *client, enum rate_dir dir, size_t bytes);
+uint64_t ratelimit_resume_ns(struct rate_client *client, enum rate_dir dir);
+
+int sockopt_listener(int listen_fd);
+void sockopt_accepted(int sock_fd);
+void sockopt_cork(int sock_fd, bool cork);
+
+int broadcast_add_notify(int event_fd);
+void broadcast_remove_notify(int event_fd);
+void broadcast_publish(void);
+
+int store_open(const char *path);
+void store_close(void);
+int store_append(const struct iovec *iov, int iovcnt);
+const char *store_data(void);
+off_t store_size(void);
+uint32_t store_records(void);
+int store_seek(uint32_t record, uint32_t record_offset, off_t *pos);
+int store_snapshot_open(const char *path);
+void store_snapshot_close(void);
+void store_snapshot_invalidate(void);
+struct store_snapshot *store_snapshot_get(void);
+void store_snapshot_put(struct store_snapshot *snapshot);
+int store_snapshot_seek(const struct store_snapshot *snapshot, uint32_t record, uint32_t record_offset,
+                        off_t *pos);
+
+int timer_start(void);
+void timer_stop(void);
+int timer_schedule(unsigned int delay_ms, unsigned int period_ms, timer_func_t func, void *arg);
+void timer_cancel(int id);
+
+int reactor_run(int *listen_fds, int num_listen_fds, int num_loops);
+void pin_thread_to_cpu(int cpu);
+
+#endif /* AESDSOCKET_H */
@@ -0,0 +1,134 @@
+/*******************************************************************************
+ * @file    broadcast.c
+ * @brief   Commit broadcast of aesdsocket. The store announces every append
+ *          once, the announcement is fanned out to the eventfds registered
+ *          by the subscribers: one per event loop serving subscribers and
+ *          one per subscriber served by a thread of its own. Subscribers
+ *          then push the new records to their clients, nobody polls the
+ *          store.
+ *
+ *          Nothing is done on an append while there are no subscribers.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+
+#include "aesdsocket.h"
+#include "logger.h"
+
+#define BROADCAST_INIT_NOTIFY   (16)
+
+static int *notify_fds;
+static int num_notify_fds;
+static int max_notify_fds;
+static atomic_int num_listeners;
+static pthread_mutex_t broadcast_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief   Registers an eventfd which is signalled after every append.
+ *
+ * @param   event_fd: Eventfd to be signalled.
+ *
+ * @return  Returns 0 on success and -1 when memory allocation fails.
+ */
+int broadcast_add_notify(int event_fd)
+{
+    int *new_fds;
+    int new_max;
+
+    pthread_mutex_lock(&broadcast_lock);
+
+    if (num_notify_fds == max_notify_fds)
+    {
+        new_max = max_notify_fds ? max_notify_fds * 2 : BROADCAST_INIT_NOTIFY;
+        new_fds = realloc(notify_fds, new_max * sizeof(int));
+
+        if (new_fds == NULL)
+        {
+            pthread_mutex_unlock(&broadcast_lock);
+            LOGGER_POST(LOG_ERR, "Error while allocating memmory to subscribers", NULL, 0);
+            return -1;
+        }
+
+        notify_fds = new_fds;
+        max_notify_fds = new_max;
+    }
+
+    notify_fds[num_notify_fds++] = event_fd;
+    atomic_store(&num_listeners, num_notify_fds);
+
+    pthread_mutex_unlock(&broadcast_lock);
+
+    // Either the appends after this are signalled or the caller sees them
+    atomic_thread_fence(memory_order_seq_cst);
+
+    return 0;
+}
+
+/**
+ * @brief   Unregisters an eventfd added by broadcast_add_notify.
+ *
+ * @param   event_fd: Eventfd to be removed.
+ *
+ * @return  void
+ */
+void broadcast_remove_notify(int event_fd)
+{
+    int i;
+
+    pthread_mutex_lock(&broadcast_lock);
+
+    for (i = 0; i < num_notify_fds; i++)
+    {
+        if (notify_fds[i] == event_fd)
+        {
+            notify_fds[i] = notify_fds[--num_notify_fds];
+            break;
+        }
+    }
+
+    atomic_store(&num_listeners, num_notify_fds);
+
+    // Array is released once the last subscriber is gone
+    if (num_notify_fds == 0)
+    {
+        free(notify_fds);
+        notify_fds = NULL;
+        max_notify_fds = 0;
+    }
+
+    pthread_mutex_unlock(&broadcast_lock);
+}
+
+/**
+ * @brief   Announces an append to all the registered eventfds. Called by the
+ *          store once the appended records are visible to the readers.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+void broadcast_publish(void)
+{
+    int i;
+
+    // Pairs with the fence of broadcast_add_notify
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&num_listeners, memory_order_relaxed) == 0)
+        return;
+
+    pthread_mutex_lock(&broadcast_lock);
+
+    for (i = 0; i < num_notify_fds; i++)
+        eventfd_write(notify_fds[i], 1);
+
+    pthread_mutex_unlock(&broadcast_lock);
+}
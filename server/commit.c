@@ -0,0 +1,488 @@
+/*******************************************************************************
+ * @file    commit.c
+ * @brief   Group commit of the records received by aesdsocket. Connections
+ *          queue their complete records to a single committer thread which
+ *          writes all the queued records to the data file with one writev()
+ *          (or one append to the store) per flush. The flush happens once the
+ *          flush interval has passed since the first queued record or when
+ *          the size thresholds are reached.
+ *
+ *          Every record gets a sequence number, a connection sends its reply
+ *          once the committed sequence number reaches the one of its record.
+ *          A record that fails to be written marks the ticket of the
+ *          connection that queued it, so the failure is seen whichever flush
+ *          it happened in. Tickets are reference counted by the connection
+ *          and its queued records, a connection may close before they are
+ *          written.
+ *          Blocking connections wait on a condition variable, event loops
+ *          register an eventfd which is signalled after every flush.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+
+#include "aesdsocket.h"
+#include "metrics.h"
+#include "logger.h"
+
+#define COMMIT_MAX_RECORDS  (1024)
+#define COMMIT_MAX_BYTES    (256 * 1024)
+#define COMMIT_MAX_NOTIFY   (MAX_LISTENERS)
+
+struct commit_ticket
+{
+    atomic_uint refs;
+    bool failed;            // Set under commit_lock
+};
+
+struct commit_request
+{
+    STAILQ_ENTRY(commit_request) entries;
+    struct commit_ticket *ticket;
+    uint64_t seq;
+    size_t len;
+    char data[];
+};
+
+STAILQ_HEAD(commit_queue_head_t, commit_request);
+
+static struct commit_queue_head_t commit_queue;
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t commit_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t commit_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t commit_thread_id;
+
+static int commit_fd = -1;
+static int commit_interval_us;
+static bool commit_running;
+static bool commit_stopping;
+
+static uint64_t next_seq = 1;
+static size_t queued_bytes;
+static int queued_count;
+
+// Last committed sequence number
+static atomic_uint_fast64_t committed_seq;
+
+static int notify_fds[COMMIT_MAX_NOTIFY];
+static int num_notify_fds;
+
+static void *commit_thread(void *arg);
+#if USE_AESD_CHAR_DEVICE
+static int writev_all(int fd, struct iovec *iov, int iovcnt);
+#endif
+
+/**
+ * @brief   Opens the data file for the committer and starts the committer
+ *          thread.
+ *
+ * @param   interval_us: Time to wait for more records after the first one
+ *          is queued, 0 to flush as soon as the committer is free.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int commit_start(int interval_us)
+{
+    int ret_status;
+
+    STAILQ_INIT(&commit_queue);
+    commit_interval_us = interval_us;
+
+#if USE_AESD_CHAR_DEVICE
+    commit_fd = open(SOCK_DATA_FILE, O_WRONLY | O_APPEND);
+
+    if (commit_fd < 0)
+    {
+        printf("Error while opening %s file: %s\n", SOCK_DATA_FILE, strerror(errno));
+        syslog(LOG_ERR, "Error while opening %s file: %s", SOCK_DATA_FILE, strerror(errno));
+        return -1;
+    }
+#endif
+
+    ret_status = pthread_create(&commit_thread_id, NULL, commit_thread, NULL);
+
+    if (ret_status != 0)
+    {
+        printf("Error while creating the committer thread: %s\n", strerror(ret_status));
+        syslog(LOG_ERR, "Error while creating the committer thread: %s", strerror(ret_status));
+        if (commit_fd >= 0)
+            close(commit_fd);
+        commit_fd = -1;
+        return -1;
+    }
+
+    commit_running = true;
+
+    return 0;
+}
+
+/**
+ * @brief   Flushes the queued records and stops the committer thread.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+void commit_stop(void)
+{
+    if (!commit_running)
+        return;
+
+    pthread_mutex_lock(&commit_lock);
+    commit_stopping = true;
+    pthread_cond_signal(&commit_cond);
+    pthread_mutex_unlock(&commit_lock);
+
+    pthread_join(commit_thread_id, NULL);
+
+    if (commit_fd >= 0)
+        close(commit_fd);
+    commit_fd = -1;
+    commit_running = false;
+}
+
+/**
+ * @brief   Creates the ticket of a connection, holding a reference for it.
+ *
+ * @param   void
+ *
+ * @return  Returns the ticket or NULL when memory allocation fails.
+ */
+struct commit_ticket *commit_ticket_new(void)
+{
+    struct commit_ticket *ticket = malloc(sizeof(struct commit_ticket));
+
+    if (ticket == NULL)
+    {
+        LOGGER_POST(LOG_ERR, "Error while allocating memmory to commit ticket", NULL, 0);
+        return NULL;
+    }
+
+    atomic_init(&ticket->refs, 1);
+    ticket->failed = false;
+
+    return ticket;
+}
+
+/**
+ * @brief   Releases a reference to the ticket, the last one frees it.
+ *
+ * @param   ticket: Ticket returned by commit_ticket_new().
+ *
+ * @return  void
+ */
+void commit_ticket_put(struct commit_ticket *ticket)
+{
+    if (atomic_fetch_sub_explicit(&ticket->refs, 1, memory_order_acq_rel) == 1)
+        free(ticket);
+}
+
+/**
+ * @brief   Queues a copy of the record to be written by the committer.
+ *
+ * @param   ticket: Ticket of the connection, marked if the write fails.
+ * @param   data: Complete record.
+ * @param   len: Length of the record.
+ * @param   seq: Set to the sequence number of the record.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int commit_submit(struct commit_ticket *ticket, const char *data, size_t len, uint64_t *seq)
+{
+    struct commit_request *request = malloc(sizeof(struct commit_request) + len);
+
+    if (request == NULL)
+    {
+        LOGGER_POST(LOG_ERR, "Error while allocating memmory to commit request", NULL, 0);
+        return -1;
+    }
+
+    memcpy(request->data, data, len);
+    request->len = len;
+    request->ticket = ticket;
+    atomic_fetch_add_explicit(&ticket->refs, 1, memory_order_relaxed);
+
+    pthread_mutex_lock(&commit_lock);
+
+    request->seq = next_seq++;
+    *seq = request->seq;
+
+    STAILQ_INSERT_TAIL(&commit_queue, request, entries);
+    queued_bytes += len;
+    queued_count++;
+
+    // Committer waits for the first record or for the thresholds
+    if (queued_count == 1 || queued_bytes >= COMMIT_MAX_BYTES || queued_count >= COMMIT_MAX_RECORDS)
+        pthread_cond_signal(&commit_cond);
+
+    pthread_mutex_unlock(&commit_lock);
+
+    return 0;
+}
+
+/**
+ * @brief   Gets the status of the records queued with a ticket up to the
+ *          given sequence number.
+ *
+ * @param   ticket: Ticket the records are queued with.
+ * @param   seq: Sequence number returned by commit_submit for the last one.
+ *
+ * @return  Returns 1 when the records are written, 0 when some are still
+ *          queued and -1 when writing any of them has failed.
+ */
+int commit_status(struct commit_ticket *ticket, uint64_t seq)
+{
+    int ret_status = 1;
+
+    if (atomic_load(&committed_seq) < seq)
+        return 0;
+
+    pthread_mutex_lock(&commit_lock);
+
+    if (ticket->failed)
+        ret_status = -1;
+
+    pthread_mutex_unlock(&commit_lock);
+
+    return ret_status;
+}
+
+/**
+ * @brief   Blocks until the record with the given sequence number is flushed.
+ *
+ * @param   seq: Sequence number returned by commit_submit.
+ *
+ * @return  void
+ */
+void commit_wait(uint64_t seq)
+{
+    pthread_mutex_lock(&commit_lock);
+
+    while (atomic_load(&committed_seq) < seq)
+        pthread_cond_wait(&commit_done_cond, &commit_lock);
+
+    pthread_mutex_unlock(&commit_lock);
+}
+
+/**
+ * @brief   Registers an eventfd to be signalled after every flush.
+ *
+ * @param   event_fd: eventfd of an event loop.
+ *
+ * @return  Returns 0 on success and -1 when too many are registered.
+ */
+int commit_add_notify(int event_fd)
+{
+    int ret_status = -1;
+
+    pthread_mutex_lock(&commit_lock);
+
+    if (num_notify_fds < COMMIT_MAX_NOTIFY)
+    {
+        notify_fds[num_notify_fds++] = event_fd;
+        ret_status = 0;
+    }
+
+    pthread_mutex_unlock(&commit_lock);
+
+    return ret_status;
+}
+
+/**
+ * @brief   Unregisters an eventfd added by commit_add_notify.
+ *
+ * @param   event_fd: eventfd of an event loop.
+ *
+ * @return  void
+ */
+void commit_remove_notify(int event_fd)
+{
+    int i;
+
+    pthread_mutex_lock(&commit_lock);
+
+    for (i = 0; i < num_notify_fds; i++)
+    {
+        if (notify_fds[i] == event_fd)
+        {
+            notify_fds[i] = notify_fds[--num_notify_fds];
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&commit_lock);
+}
+
+/**
+ * @brief   Committer thread, writes the queued records in batches until
+ *          stopped and the queue is empty.
+ *
+ * @param   arg: Unused.
+ *
+ * @return  void
+ */
+static void *commit_thread(void *arg)
+{
+    struct commit_queue_head_t batch;
+    struct commit_request *request;
+    struct iovec iov[COMMIT_MAX_RECORDS];
+    struct timespec deadline;
+    uint64_t last_seq;
+    uint64_t write_start_ns;
+    int iovcnt;
+    int ret_status;
+    int i;
+
+    pthread_mutex_lock(&commit_lock);
+
+    while (true)
+    {
+        while (STAILQ_EMPTY(&commit_queue) && !commit_stopping)
+            pthread_cond_wait(&commit_cond, &commit_lock);
+
+        if (STAILQ_EMPTY(&commit_queue))
+            break;
+
+        // Give other connections the flush interval to join the batch
+        if (commit_interval_us > 0 && !commit_stopping)
+        {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)commit_interval_us * 1000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+
+            while (queued_bytes < COMMIT_MAX_BYTES && queued_count < COMMIT_MAX_RECORDS && !commit_stopping)
+            {
+                if (pthread_cond_timedwait(&commit_cond, &commit_lock, &deadline) == ETIMEDOUT)
+                    break;
+            }
+        }
+
+        // Detach at most COMMIT_MAX_RECORDS records from the queue
+        STAILQ_INIT(&batch);
+        iovcnt = 0;
+
+        while (!STAILQ_EMPTY(&commit_queue) && iovcnt < COMMIT_MAX_RECORDS)
+        {
+            request = STAILQ_FIRST(&commit_queue);
+            STAILQ_REMOVE_HEAD(&commit_queue, entries);
+            STAILQ_INSERT_TAIL(&batch, request, entries);
+
+            iov[iovcnt].iov_base = request->data;
+            iov[iovcnt].iov_len = request->len;
+            iovcnt++;
+
+            last_seq = request->seq;
+
+            queued_bytes -= request->len;
+            queued_count--;
+        }
+
+        pthread_mutex_unlock(&commit_lock);
+
+        write_start_ns = metrics_now();
+#if USE_AESD_CHAR_DEVICE
+        ret_status = writev_all(commit_fd, iov, iovcnt);
+
+        // Part of the batch may be written even on error
+        store_snapshot_invalidate();
+#else
+        ret_status = store_append(iov, iovcnt);
+#endif
+        metrics_latency(METRIC_WRITE, write_start_ns);
+
+        if (ret_status)
+            LOGGER_POST(LOG_ERR, "Error while writing to the file", NULL, errno);
+
+        pthread_mutex_lock(&commit_lock);
+
+        if (ret_status)
+        {
+            STAILQ_FOREACH(request, &batch, entries)
+                request->ticket->failed = true;
+        }
+
+        atomic_store(&committed_seq, last_seq);
+        pthread_cond_broadcast(&commit_done_cond);
+
+        for (i = 0; i < num_notify_fds; i++)
+            eventfd_write(notify_fds[i], 1);
+
+        pthread_mutex_unlock(&commit_lock);
+
+        while (!STAILQ_EMPTY(&batch))
+        {
+            request = STAILQ_FIRST(&batch);
+            STAILQ_REMOVE_HEAD(&batch, entries);
+            commit_ticket_put(request->ticket);
+            free(request);
+        }
+
+        pthread_mutex_lock(&commit_lock);
+    }
+
+    pthread_mutex_unlock(&commit_lock);
+
+    return arg;
+}
+
+#if USE_AESD_CHAR_DEVICE
+/**
+ * @brief   Writes all the bytes described by iov, continues after partial
+ *          writes.
+ *
+ * @param   fd: File descriptor to be written.
+ * @param   iov: Buffers to be written, modified on partial writes.
+ * @param   iovcnt: Number of buffers.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+static int writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t ret_status;
+
+    while (iovcnt > 0)
+    {
+        ret_status = writev(fd, iov, iovcnt > IOV_MAX ? IOV_MAX : iovcnt);
+
+        if (ret_status < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        // Skip the buffers written completely and adjust the partial one
+        while (iovcnt > 0 && (size_t)ret_status >= iov->iov_len)
+        {
+            ret_status -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + ret_status;
+            iov->iov_len -= ret_status;
+        }
+    }
+
+    return 0;
+}
+#endif
@@ -0,0 +1,1800 @@
+/*******************************************************************************
+ * @file    connection.c
+ * @brief   Per-connection state machine of aesdsocket. Receives records
+ *          terminated by '\n' from the client, writes each of them to the
+ *          data file (or executes the "AESDCHAR_IOCSEEKTO:X,Y" command) and
+ *          streams the contents of the data file back to the client. A
+ *          malformed command closes the connection, it is never stored.
+ *
+ *          Received bytes are kept in a per-connection buffer which is
+ *          reused across reads. Only the newly received bytes are searched
+ *          for '\n', every complete record is processed in order and the
+ *          partial record at the end is carried to the next read.
+ *
+ *          Replies are sent with sendfile() so that the data file bytes
+ *          are moved to the socket inside the kernel. When it is disabled
+ *          (-c) or not supported by the data file replies are sent out of a
+ *          snapshot of the contents shared by the clients replying at the
+ *          same generation, read()/send() copy loop is used when it cannot be
+ *          allocated. Binary reads of the char device are sent out of a
+ *          snapshot too, so that the announced size is what is sent.
+ *          Without the char device records are appended to the mapped store
+ *          and replies are sent straight out of the mapping. With the ring
+ *          store replies are always sent out of a snapshot.
+ *
+ *          "AESDCHAR_SUBSCRIBE[:X,Y]" turns the connection into a subscriber
+ *          which gets the contents, from the given position, and then every
+ *          record pushed as it is appended. Subscribers are woken by the
+ *          commit broadcast of the store and need the mapped or the ring
+ *          store, their cursor is kept in offsets that never shift.
+ *
+ *          "AESDCHAR_BINARY" switches the connection to the framed protocol
+ *          of frame.h. Appends received together are written with a single
+ *          store append and replies are limited to the requested range.
+ *
+ *          In low-latency mode a reply sent in several calls is corked, with
+ *          MSG_MORE out of the store and TCP_CORK otherwise, and leaves in
+ *          full segments once its last byte is queued.
+ *
+ *          The handlers work on both blocking and non-blocking sockets, on
+ *          a non-blocking socket they return CONN_AGAIN when the socket
+ *          would block so that the caller can wait for the next event.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+
+#include "aesdsocket.h"
+#include "metrics.h"
+#include "logger.h"
+#include "frame.h"
+#include "../aesd-char-driver/aesd_ioctl.h"
+
+#define SEEKTO_CMD          ("AESDCHAR_IOCSEEKTO:")
+#define SEEKTO_CMD_LEN      (sizeof(SEEKTO_CMD) - 1)
+#define SUBSCRIBE_CMD       ("AESDCHAR_SUBSCRIBE")
+#define SUBSCRIBE_CMD_LEN   (sizeof(SUBSCRIBE_CMD) - 1)
+#define SEEKTO_ARGS_MAX_LEN (32)    // "X,Y" of two 32 bit values with room to spare
+#define FRAME_MAX_BATCH     (64)
+
+// Set when the data file does not support sendfile()
+static atomic_bool sendfile_unsupported;
+
+static int connection_process_record(struct connection *conn, char *record, size_t record_len,
+                                     uint64_t parse_start_ns);
+static int connection_process_frames(struct connection *conn, uint64_t parse_start_ns);
+static int connection_frame_seek(struct connection *conn, const struct frame_header *header, const char *payload);
+static int connection_frame_read(struct connection *conn, const struct frame_header *header, const char *payload);
+static int connection_frame_stat(struct connection *conn);
+static int connection_reply_frame(struct connection *conn, uint8_t opcode, uint8_t status, const void *payload,
+                                  uint32_t payload_len, uint32_t data_len);
+static int connection_append(struct connection *conn, const struct iovec *iov, int iovcnt);
+static int connection_seek(struct connection *conn, const struct aesd_seekto *seekto);
+static bool rx_next_record(struct rx_buffer *rx, char **record, size_t *record_len);
+static int rx_frame_ready(const struct rx_buffer *rx, struct frame_header *header);
+static bool rx_next_frame(struct rx_buffer *rx, struct frame_header *header, char **payload);
+static int rx_reserve(struct rx_buffer *rx, size_t min_free);
+static int connection_send_frame(struct connection *conn);
+static int connection_sendfile(struct connection *conn);
+#if USE_AESD_CHAR_DEVICE || USE_AESD_RING_STORE
+static int connection_send_snapshot(struct connection *conn);
+#else
+static int connection_send_store(struct connection *conn);
+#endif
+static void connection_reply_done(struct connection *conn);
+static int connection_reply_eof(struct connection *conn);
+static size_t connection_reply_left(struct connection *conn, size_t max);
+static off_t connection_read_cursor(struct connection *conn);
+static void connection_serve_subscriber(struct connection *conn);
+static void connection_received(struct connection *conn, size_t len);
+static void connection_sent(struct connection *conn, size_t len);
+static bool connection_throttled(struct connection *conn, enum rate_dir dir);
+static int connection_throttle_ms(struct connection *conn);
+static int parse_seekto(char *buffer, size_t buffer_len, struct aesd_seekto *seekto);
+static int parse_subscribe(char *buffer, size_t buffer_len, struct aesd_seekto *seekto, bool *has_seekto);
+static int parse_seekto_args(char *buffer, size_t buffer_len, size_t cmd_len, struct aesd_seekto *seekto);
+
+/**
+ * @brief   Initializes the connection state for a newly accepted client and
+ *          opens the data file for it.
+ *
+ * @param   conn: Connection to be initialized.
+ * @param   sock_fd: Accepted client socket.
+ * @param   addr: Address of the client.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int connection_init(struct connection *conn, int sock_fd, struct sockaddr_in *addr)
+{
+    memset(conn, 0, sizeof(*conn));
+
+    conn->sock_fd = sock_fd;
+    conn->addr = *addr;
+
+    // Local clients have no address, all of them are logged and limited as one
+    if (addr->sin_family != AF_INET)
+    {
+        memset(&conn->addr, 0, sizeof(conn->addr));
+        conn->addr.sin_family = AF_UNIX;
+    }
+    conn->accept_ns = metrics_now();
+
+    metrics_add(METRIC_CONN_OPENED, 1);
+
+    // Address is converted to string by the log writer
+    LOGGER_POST(LOG_INFO, "Accepted connection from", &conn->addr, 0);
+
+    if (admission_open(conn))
+        return -1;
+
+    // Sanitized address, the local clients share one bucket
+    conn->rate_client = ratelimit_get(&conn->addr);
+
+    if (addr->sin_family == AF_INET)
+        sockopt_accepted(sock_fd);
+
+#if USE_AESD_CHAR_DEVICE
+    conn->file_fd = open(SOCK_DATA_FILE, O_RDWR | O_APPEND);
+
+    if (conn->file_fd < 0)
+    {
+        LOGGER_POST(LOG_ERR, "Error while opening the data file", NULL, errno);
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief   Processes the next complete record received from the client,
+ *          receives more data from the client when no record is buffered.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns CONN_DONE when a record is processed and the reply is
+ *          ready to be sent, CONN_AGAIN when the socket would block,
+ *          CONN_THROTTLED when the client is over its rate and CONN_CLOSE
+ *          on error or when the client closed the connection.
+ */
+int connection_read(struct connection *conn)
+{
+    struct frame_header header;
+    char *record;
+    size_t record_len;
+    uint64_t parse_start_ns;
+    int ret_status;
+
+    while (!sig_exit_status)
+    {
+        parse_start_ns = metrics_now();
+
+        if (conn->binary)
+        {
+            ret_status = rx_frame_ready(&conn->rx, &header);
+
+            if (ret_status < 0)
+            {
+                LOGGER_POST(LOG_WARNING, "Frame too large, closing", &conn->addr, 0);
+                return CONN_CLOSE;
+            }
+
+            if (ret_status > 0)
+                return connection_process_frames(conn, parse_start_ns);
+        }
+        else if (rx_next_record(&conn->rx, &record, &record_len))
+        {
+            return connection_process_record(conn, record, record_len, parse_start_ns);
+        }
+
+        if (connection_throttled(conn, RATE_IN))
+            return CONN_THROTTLED;
+
+        ret_status = sock_read(conn->sock_fd, &conn->rx);
+
+        if (ret_status == -EAGAIN)
+            return CONN_AGAIN;
+
+        if (ret_status < 0)
+            return CONN_CLOSE;
+
+        connection_received(conn, ret_status);
+
+        if (conn->accept_ns)
+        {
+            metrics_latency(METRIC_FIRST_BYTE, conn->accept_ns);
+            conn->accept_ns = 0;
+        }
+    }
+
+    return CONN_CLOSE;
+}
+
+/**
+ * @brief   Checks if a complete record is already received and waiting to
+ *          be processed.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns true when a '\n' is found in the buffered bytes, or a
+ *          frame in binary mode.
+ */
+bool connection_has_record(struct connection *conn)
+{
+    struct rx_buffer *rx = &conn->rx;
+    size_t scan_from = rx->scanned > rx->start ? rx->scanned : rx->start;
+    struct frame_header header;
+
+    if (conn->binary)
+        return rx_frame_ready(rx, &header) != 0;
+
+    if (scan_from == rx->len)
+        return false;
+
+    return memchr(rx->data + scan_from, '\n', rx->len - scan_from) != NULL;
+}
+
+/**
+ * @brief   Serves the connection on a blocking socket. Every record is
+ *          followed by its reply. The connection is kept open until the
+ *          client closes it in keep-alive mode, otherwise it is closed once
+ *          the records received along with the first one are served.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  void
+ */
+void connection_serve(struct connection *conn)
+{
+    struct pollfd exit_fd = { .fd = exit_event_fd, .events = POLLIN };
+    int ret_status;
+
+    while (true)
+    {
+        ret_status = connection_read(conn);
+
+        // Sleep is cut short by exit
+        if (ret_status == CONN_THROTTLED)
+        {
+            poll(&exit_fd, 1, connection_throttle_ms(conn));
+            continue;
+        }
+
+        if (ret_status != CONN_DONE)
+            break;
+
+        if (conn->subscribed)
+        {
+            connection_serve_subscriber(conn);
+            break;
+        }
+
+        while ((ret_status = connection_write(conn)) == CONN_COMMIT || ret_status == CONN_THROTTLED)
+        {
+            if (ret_status == CONN_COMMIT)
+                commit_wait(conn->commit_seq);
+            else if (poll(&exit_fd, 1, connection_throttle_ms(conn)) > 0)
+                break;
+        }
+
+        if (ret_status != CONN_DONE)
+            break;
+
+        if (!server_config.keep_alive && !conn->binary && !connection_has_record(conn))
+            break;
+    }
+}
+
+/**
+ * @brief   Serves a subscriber on a blocking socket. The eventfd of the
+ *          connection is registered before the first reply, so no append
+ *          is missed, and the new records are pushed every time it is
+ *          signalled until the client is gone or exit is requested. Bytes
+ *          sent by the client are dropped.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  void
+ */
+static void connection_serve_subscriber(struct connection *conn)
+{
+    struct pollfd fds[3];
+    eventfd_t value;
+    int timeout_ms;
+    int ret_status;
+
+    conn->notify_fd = eventfd(0, EFD_CLOEXEC);
+
+    if (conn->notify_fd < 0 || broadcast_add_notify(conn->notify_fd))
+    {
+        LOGGER_POST(LOG_ERR, "Failed to subscribe the connection", &conn->addr, errno);
+        return;
+    }
+
+    fds[0].fd = conn->sock_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = conn->notify_fd;
+    fds[1].events = POLLIN;
+    fds[2].fd = exit_event_fd;
+    fds[2].events = POLLIN;
+
+    while (!sig_exit_status)
+    {
+        ret_status = connection_push(conn);
+
+        // Throttled push is resumed once the rate allows
+        if (ret_status == CONN_THROTTLED)
+            timeout_ms = connection_throttle_ms(conn);
+        else if (ret_status == CONN_DONE)
+            timeout_ms = -1;
+        else
+            break;
+
+        if (poll(fds, 3, timeout_ms) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            LOGGER_POST(LOG_ERR, "Error while waiting for records", &conn->addr, errno);
+            break;
+        }
+
+        if (fds[0].revents & (POLLERR | POLLHUP))
+            break;
+
+        // Subscription outlives the write side of the client
+        if (fds[0].revents & POLLIN)
+        {
+            ret_status = connection_discard(conn);
+
+            if (ret_status == CONN_CLOSE)
+                break;
+
+            if (ret_status == CONN_DONE)
+                fds[0].events = 0;
+        }
+
+        if (fds[1].revents & POLLIN)
+            eventfd_read(conn->notify_fd, &value);
+    }
+}
+
+/**
+ * @brief   Pushes the records appended since the last push to a subscriber,
+ *          or resumes the push pending on the socket.
+ *
+ * @param   conn: Subscribed connection.
+ *
+ * @return  Returns CONN_DONE when the client has all the records,
+ *          CONN_AGAIN when the socket would block, CONN_THROTTLED when the
+ *          client is over its rate and CONN_CLOSE on error.
+ */
+int connection_push(struct connection *conn)
+{
+#if USE_AESD_RING_STORE
+    uint64_t start;
+#endif
+
+    if (conn->reply_pending)
+        return connection_write(conn);
+
+    if (connection_throttled(conn, RATE_OUT))
+        return CONN_THROTTLED;
+
+#if USE_AESD_RING_STORE
+    conn->snapshot = store_snapshot_get();
+
+    if (conn->snapshot == NULL)
+        return CONN_CLOSE;
+
+    if ((uint64_t)conn->read_cursor >= conn->snapshot->stream_end)
+    {
+        store_snapshot_put(conn->snapshot);
+        conn->snapshot = NULL;
+        admission_idle(conn);
+        return CONN_DONE;
+    }
+
+    // Records dropped by the ring before they could be pushed are skipped
+    start = conn->snapshot->stream_end - conn->snapshot->size;
+    conn->reply_offset = (uint64_t)conn->read_cursor > start ? conn->read_cursor - start : 0;
+#else
+    if (store_size() <= conn->read_cursor)
+    {
+        admission_idle(conn);
+        return CONN_DONE;
+    }
+
+    conn->reply_offset = conn->read_cursor;
+#endif
+
+    conn->reply_pending = true;
+    conn->reply_len = 0;
+    conn->reply_sent = 0;
+    conn->reply_start_ns = metrics_now();
+
+    // Write deadline runs until the client has the records
+    admission_touch(conn);
+
+    return connection_write(conn);
+}
+
+/**
+ * @brief   Drops the bytes sent by a subscriber, it only receives records.
+ *
+ * @param   conn: Subscribed connection.
+ *
+ * @return  Returns CONN_AGAIN when all the bytes are dropped, CONN_DONE
+ *          once the client has shut down its side and CONN_CLOSE on error.
+ */
+int connection_discard(struct connection *conn)
+{
+    char buffer[BUFFER_MAX_SIZE];
+    ssize_t ret_status;
+
+    while ((ret_status = recv(conn->sock_fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+        metrics_add(METRIC_BYTES_IN, ret_status);
+
+    if (ret_status == 0)
+        return CONN_DONE;
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return CONN_AGAIN;
+
+    LOGGER_POST(LOG_ERR, "Error while getting data from the client", &conn->addr, errno);
+    return CONN_CLOSE;
+}
+
+/**
+ * @brief   Streams the data file to the client starting from the reply
+ *          offset of the connection.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns CONN_DONE when all the bytes are sent, CONN_AGAIN when
+ *          the socket would block, CONN_COMMIT when the record is not yet
+ *          written by the group commit, CONN_THROTTLED when the client is
+ *          over its rate and CONN_CLOSE on error.
+ */
+int connection_write(struct connection *conn)
+{
+    ssize_t ret_status;
+
+    if (conn->commit_pending)
+    {
+        ret_status = commit_status(conn->commit_ticket, conn->commit_seq);
+
+        if (ret_status == 0)
+            return CONN_COMMIT;
+
+        conn->commit_pending = false;
+
+        if (ret_status < 0)
+            return CONN_CLOSE;
+
+        // Cursor is limited once the record is in the data file
+        if (server_config.incremental && !conn->binary)
+            conn->reply_offset = connection_read_cursor(conn);
+
+        conn->reply_start_ns = metrics_now();
+    }
+
+    if (conn->reply_pending && connection_throttled(conn, RATE_OUT))
+        return CONN_THROTTLED;
+
+    // Header of a binary reply goes out ahead of its data
+    if (conn->reply_pending && conn->binary)
+    {
+        ret_status = connection_send_frame(conn);
+
+        if (ret_status != CONN_DONE || !conn->reply_pending)
+            return ret_status;
+    }
+
+#if USE_AESD_CHAR_DEVICE
+    /*
+     * Text replies are sent from the device with sendfile(), the shared
+     * snapshot takes the place of the copy loop when sendfile() is disabled
+     * (-c) or not supported. A binary read is sent out of the snapshot its
+     * size was announced from.
+     */
+    if (conn->reply_pending && conn->snapshot == NULL && !conn->binary &&
+        (!server_config.zero_copy || atomic_load(&sendfile_unsupported)))
+        conn->snapshot = store_snapshot_get();
+
+    if (conn->reply_pending && conn->snapshot)
+        return connection_send_snapshot(conn);
+#elif USE_AESD_RING_STORE
+    if (conn->reply_pending && conn->snapshot == NULL)
+        conn->snapshot = store_snapshot_get();
+
+    if (conn->reply_pending && conn->snapshot)
+        return connection_send_snapshot(conn);
+
+    // Ring has no data file to fall back to
+    if (conn->reply_pending)
+        return CONN_CLOSE;
+#else
+    if (conn->reply_pending)
+        return connection_send_store(conn);
+#endif
+
+    /*
+     * Copy loop, only used when a snapshot can't be allocated, and sendfile()
+     * queue the reply in chunks, sent as one.
+     */
+    if (conn->reply_pending && server_config.low_latency && !conn->corked &&
+        conn->addr.sin_family == AF_INET)
+    {
+        sockopt_cork(conn->sock_fd, true);
+        conn->corked = true;
+    }
+
+    while (conn->reply_pending)
+    {
+        // Zero-copy path, only taken once the copied bytes are all sent
+        if (conn->reply_sent == conn->reply_len && server_config.zero_copy &&
+            !atomic_load(&sendfile_unsupported))
+        {
+            ret_status = connection_sendfile(conn);
+
+            if (ret_status != CONN_DONE || !conn->reply_pending)
+                return ret_status;
+        }
+
+        // Refill the reply buffer once all of its bytes are sent
+        if (conn->reply_sent == conn->reply_len)
+        {
+            ret_status = pread(conn->file_fd, conn->reply_buffer, connection_reply_left(conn, BUFFER_MAX_SIZE),
+                               conn->reply_offset);
+
+            if (ret_status < 0)
+            {
+                LOGGER_POST(LOG_ERR, "Error while reading from the file", NULL, errno);
+                return CONN_CLOSE;
+            }
+
+            if (ret_status == 0)
+                return connection_reply_eof(conn);
+
+            conn->reply_offset += ret_status;
+            conn->reply_len = ret_status;
+            conn->reply_sent = 0;
+        }
+
+        ret_status = send(conn->sock_fd, conn->reply_buffer + conn->reply_sent,
+                          conn->reply_len - conn->reply_sent, MSG_NOSIGNAL);
+
+        if (ret_status < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return CONN_AGAIN;
+
+            LOGGER_POST(LOG_ERR, "Error while sending data to the client", &conn->addr, errno);
+            return CONN_CLOSE;
+        }
+
+        connection_sent(conn, ret_status);
+        conn->reply_sent += ret_status;
+    }
+
+    return CONN_DONE;
+}
+
+/**
+ * @brief   Sends the header of a binary reply, and its payload, completing
+ *          the reply when it has no data to follow.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns CONN_DONE when the header is sent, CONN_AGAIN when the
+ *          socket would block and CONN_CLOSE on error.
+ */
+static int connection_send_frame(struct connection *conn)
+{
+    ssize_t ret_status;
+    int flags;
+
+    while (conn->reply_sent < conn->reply_len)
+    {
+        flags = MSG_NOSIGNAL;
+
+        // Header leaves in the same segment as the data, not held by Nagle on its own
+        if (conn->reply_offset < conn->reply_end)
+            flags |= MSG_MORE;
+
+        ret_status = send(conn->sock_fd, conn->reply_buffer + conn->reply_sent,
+                          conn->reply_len - conn->reply_sent, flags);
+
+        if (ret_status < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return CONN_AGAIN;
+
+            LOGGER_POST(LOG_ERR, "Error while sending data to the client", &conn->addr, errno);
+            return CONN_CLOSE;
+        }
+
+        connection_sent(conn, ret_status);
+        conn->reply_sent += ret_status;
+    }
+
+    if (conn->reply_offset >= conn->reply_end)
+        connection_reply_done(conn);
+
+    return CONN_DONE;
+}
+
+/**
+ * @brief   Sends the data file to the client with sendfile() starting from
+ *          the reply offset. Falls back to the copy loop for all the
+ *          connections when the data file does not support sendfile().
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns CONN_DONE when the reply is sent or sendfile() is not
+ *          supported, CONN_AGAIN when the socket would block and CONN_CLOSE
+ *          on error.
+ */
+static int connection_sendfile(struct connection *conn)
+{
+    ssize_t ret_status;
+
+    while (true)
+    {
+        ret_status = sendfile(conn->sock_fd, conn->file_fd, &conn->reply_offset,
+                              connection_reply_left(conn, REPLY_CHUNK_SIZE));
+
+        if (ret_status > 0)
+        {
+            connection_sent(conn, ret_status);
+            continue;
+        }
+
+        if (ret_status == 0)
+            return connection_reply_eof(conn);
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return CONN_AGAIN;
+
+        if (errno == EINVAL || errno == ENOSYS)
+        {
+            if (!atomic_exchange(&sendfile_unsupported, true))
+            {
+                printf("sendfile not supported by %s, using copy loop\n", SOCK_DATA_FILE);
+                syslog(LOG_WARNING, "sendfile not supported by %s, using copy loop", SOCK_DATA_FILE);
+            }
+
+            return CONN_DONE;
+        }
+
+        LOGGER_POST(LOG_ERR, "Error while sending file to the client", &conn->addr, errno);
+        return CONN_CLOSE;
+    }
+}
+
+#if USE_AESD_CHAR_DEVICE || USE_AESD_RING_STORE
+/**
+ * @brief   Sends the snapshot held by the connection to the client starting
+ *          from the reply offset, till the reply end in binary mode, and
+ *          releases it once sent.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns CONN_DONE when the whole snapshot is sent, CONN_AGAIN
+ *          when the socket would block and CONN_CLOSE on error.
+ */
+static int connection_send_snapshot(struct connection *conn)
+{
+    struct store_snapshot *snapshot = conn->snapshot;
+    off_t end = conn->binary ? conn->reply_end : (off_t)snapshot->size;
+    ssize_t ret_status;
+
+    while (conn->reply_offset < end)
+    {
+        ret_status = send(conn->sock_fd, snapshot->data + conn->reply_offset, end - conn->reply_offset, MSG_NOSIGNAL);
+
+        if (ret_status < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return CONN_AGAIN;
+
+            LOGGER_POST(LOG_ERR, "Error while sending data to the client", &conn->addr, errno);
+            return CONN_CLOSE;
+        }
+
+        connection_sent(conn, ret_status);
+        conn->reply_offset += ret_status;
+    }
+
+#if USE_AESD_RING_STORE
+    // Cursor of a subscriber is kept in stream offsets, they do not shift as the ring wraps
+    if (conn->subscribed)
+        conn->reply_offset += snapshot->stream_end - snapshot->size;
+#endif
+
+    store_snapshot_put(snapshot);
+    conn->snapshot = NULL;
+
+    connection_reply_done(conn);
+
+    return CONN_DONE;
+}
+#else
+/**
+ * @brief   Sends the store to the client out of its mapping starting from
+ *          the reply offset.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns CONN_DONE when all the published bytes, or the ones till
+ *          the reply end in binary mode, are sent,
+ *          CONN_AGAIN when the socket would block and CONN_CLOSE on error.
+ */
+static int connection_send_store(struct connection *conn)
+{
+    const char *data = store_data();
+    off_t data_size;
+    size_t len;
+    ssize_t ret_status;
+    int flags;
+
+    while ((data_size = store_size()) > conn->reply_offset &&
+           (len = connection_reply_left(conn, data_size - conn->reply_offset)) > 0)
+    {
+        flags = MSG_NOSIGNAL;
+
+        if (len > REPLY_CHUNK_SIZE)
+        {
+            len = REPLY_CHUNK_SIZE;
+
+            // Partial segment at the end of the chunk waits for the next one
+            if (server_config.low_latency)
+                flags |= MSG_MORE;
+        }
+
+        ret_status = send(conn->sock_fd, data + conn->reply_offset, len, flags);
+
+        if (ret_status < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return CONN_AGAIN;
+
+            LOGGER_POST(LOG_ERR, "Error while sending data to the client", &conn->addr, errno);
+            return CONN_CLOSE;
+        }
+
+        connection_sent(conn, ret_status);
+        conn->reply_offset += ret_status;
+    }
+
+    connection_reply_done(conn);
+
+    return CONN_DONE;
+}
+#endif
+
+/**
+ * @brief   Marks the reply as complete, the client has now seen the data
+ *          file till the reply offset.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  void
+ */
+static void connection_reply_done(struct connection *conn)
+{
+    conn->reply_pending = false;
+    conn->read_cursor = conn->reply_offset;
+
+#if USE_AESD_CHAR_DEVICE || USE_AESD_RING_STORE
+    // Held by a binary reply with no data to send
+    if (conn->snapshot)
+    {
+        store_snapshot_put(conn->snapshot);
+        conn->snapshot = NULL;
+    }
+#endif
+
+    // Pushes out the partial segment held back
+    if (conn->corked)
+    {
+        sockopt_cork(conn->sock_fd, false);
+        conn->corked = false;
+    }
+
+    metrics_latency(METRIC_REPLY, conn->reply_start_ns);
+}
+
+/**
+ * @brief   Completes the reply once the data file has no more bytes. A
+ *          binary reply has announced its length, it can not end early.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns CONN_DONE when the reply is complete and CONN_CLOSE when
+ *          the data file has shrunk under a binary reply.
+ */
+static int connection_reply_eof(struct connection *conn)
+{
+    if (conn->binary && conn->reply_offset < conn->reply_end)
+    {
+        LOGGER_POST(LOG_WARNING, "Data file shrunk under the reply, closing", &conn->addr, 0);
+        return CONN_CLOSE;
+    }
+
+    connection_reply_done(conn);
+
+    return CONN_DONE;
+}
+
+/**
+ * @brief   Limits the bytes sent next to the end of a binary reply.
+ *
+ * @param   conn: Client connection.
+ * @param   max: Bytes that would be sent otherwise.
+ *
+ * @return  Returns the number of bytes to be sent.
+ */
+static size_t connection_reply_left(struct connection *conn, size_t max)
+{
+    if (conn->binary && (off_t)max > conn->reply_end - conn->reply_offset)
+        return conn->reply_end - conn->reply_offset;
+
+    return max;
+}
+
+/**
+ * @brief   Gets the offset of the first byte not yet sent to the client. The
+ *          cursor is limited to the size of the data file as the driver drops
+ *          the oldest writes once its buffer is full, a client can resync
+ *          with "AESDCHAR_IOCSEEKTO:X,Y" command in that case.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns the read cursor of the connection.
+ */
+static off_t connection_read_cursor(struct connection *conn)
+{
+#if USE_AESD_CHAR_DEVICE
+    off_t data_size = lseek(conn->file_fd, 0, SEEK_END);
+#else
+    off_t data_size = store_size();
+#endif
+
+    if (data_size >= 0 && conn->read_cursor > data_size)
+        conn->read_cursor = data_size;
+
+    return conn->read_cursor;
+}
+
+/**
+ * @brief   Closes the data file and the client socket and frees the
+ *          buffers held by the connection.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  void
+ */
+void connection_close(struct connection *conn)
+{
+    if (conn->notify_fd > 0)
+    {
+        broadcast_remove_notify(conn->notify_fd);
+        close(conn->notify_fd);
+        conn->notify_fd = 0;
+    }
+
+#if USE_AESD_CHAR_DEVICE || USE_AESD_RING_STORE
+    if (conn->snapshot)
+    {
+        store_snapshot_put(conn->snapshot);
+        conn->snapshot = NULL;
+    }
+#endif
+
+    if (conn->rate_client)
+    {
+        ratelimit_put(conn->rate_client);
+        conn->rate_client = NULL;
+    }
+
+    // Records still queued keep the ticket until they are written
+    if (conn->commit_ticket)
+    {
+        commit_ticket_put(conn->commit_ticket);
+        conn->commit_ticket = NULL;
+    }
+
+    if (conn->file_fd > 0)
+    {
+        close(conn->file_fd);
+        conn->file_fd = 0;
+    }
+
+    if (conn->rx.data)
+    {
+        admission_release(conn->rx.cap);
+        free(conn->rx.data);
+        memset(&conn->rx, 0, sizeof(conn->rx));
+    }
+
+    if (conn->sock_fd > 0)
+    {
+        admission_close(conn);
+        conn->sock_fd = 0;
+        metrics_add(METRIC_CONN_CLOSED, 1);
+        LOGGER_POST(LOG_INFO, "Closed connection from", &conn->addr, 0);
+    }
+}
+
+/**
+ * @brief   Accounts bytes received from the client.
+ *
+ * @param   conn: Client connection.
+ * @param   len: Number of bytes received.
+ *
+ * @return  void
+ */
+static void connection_received(struct connection *conn, size_t len)
+{
+    metrics_add(METRIC_BYTES_IN, len);
+    admission_touch(conn);
+    conn->deficit -= len;
+
+    if (conn->rate_client)
+        ratelimit_charge(conn->rate_client, RATE_IN, len);
+}
+
+/**
+ * @brief   Accounts bytes sent to the client.
+ *
+ * @param   conn: Client connection.
+ * @param   len: Number of bytes sent.
+ *
+ * @return  void
+ */
+static void connection_sent(struct connection *conn, size_t len)
+{
+    metrics_add(METRIC_BYTES_OUT, len);
+    admission_touch(conn);
+    conn->deficit -= len;
+
+    if (conn->rate_client)
+        ratelimit_charge(conn->rate_client, RATE_OUT, len);
+}
+
+/**
+ * @brief   Checks the rate of the client before a transfer. A throttled
+ *          connection has no idle deadline until it is resumed.
+ *
+ * @param   conn: Client connection.
+ * @param   dir: Direction of the transfer.
+ *
+ * @return  Returns true with resume_ns of the connection set when the
+ *          client is over its rate.
+ */
+static bool connection_throttled(struct connection *conn, enum rate_dir dir)
+{
+    uint64_t resume_ns;
+
+    if (conn->rate_client == NULL)
+        return false;
+
+    resume_ns = ratelimit_resume_ns(conn->rate_client, dir);
+
+    if (resume_ns)
+    {
+        conn->resume_ns = resume_ns;
+        admission_idle(conn);
+        return true;
+    }
+
+    // Deadline restarts once resumed
+    if (conn->resume_ns)
+    {
+        conn->resume_ns = 0;
+        admission_touch(conn);
+    }
+
+    return false;
+}
+
+/**
+ * @brief   Gets the time left until a throttled connection is resumed.
+ *
+ * @param   conn: Throttled connection.
+ *
+ * @return  Returns the time in milliseconds, rounded up.
+ */
+static int connection_throttle_ms(struct connection *conn)
+{
+    uint64_t now_ns = ratelimit_now();
+
+    if (conn->resume_ns <= now_ns)
+        return 0;
+
+    return (conn->resume_ns - now_ns + 999999) / 1000000;
+}
+
+/**
+ * @brief   Writes the received record to the data file or executes the seek
+ *          command and sets up the reply.
+ *
+ * @param   conn: Client connection.
+ * @param   record: Complete record including the '\n' character.
+ * @param   record_len: Length of the record.
+ * @param   parse_start_ns: Time the search for the record has started.
+ *
+ * @return  Returns CONN_DONE on success and CONN_CLOSE on error.
+ */
+static int connection_process_record(struct connection *conn, char *record, size_t record_len,
+                                     uint64_t parse_start_ns)
+{
+    struct iovec iov = { .iov_base = record, .iov_len = record_len };
+    struct aesd_seekto seekto;
+    uint32_t version;
+    int cmd_status;
+    int is_seekto;
+    int is_subscribe = 0;
+    bool has_seekto = false;
+
+    // Frames follow the command, the ones received along with it included
+    if (record_len == FRAME_CMD_LEN + 1 && !memcmp(record, FRAME_CMD, FRAME_CMD_LEN))
+    {
+        metrics_latency(METRIC_PARSE, parse_start_ns);
+
+        conn->binary = true;
+        version = htobe32(FRAME_VERSION);
+
+        return connection_reply_frame(conn, FRAME_OP_HELLO, FRAME_STATUS_OK, &version, sizeof(version), 0);
+    }
+
+    // Check if received string contains command
+    cmd_status = parse_seekto(record, record_len, &seekto);
+    is_seekto = cmd_status == 0;
+
+    if (cmd_status > 0)
+    {
+        cmd_status = parse_subscribe(record, record_len, &seekto, &has_seekto);
+        is_subscribe = cmd_status == 0;
+    }
+
+    metrics_latency(METRIC_PARSE, parse_start_ns);
+
+    // Malformed commands are not stored as data
+    if (cmd_status < 0)
+    {
+        LOGGER_POST(LOG_WARNING, "Malformed command, closing", &conn->addr, 0);
+        return CONN_CLOSE;
+    }
+
+    metrics_add(METRIC_RECORDS, 1);
+
+    if (is_subscribe)
+    {
+#if USE_AESD_CHAR_DEVICE
+        // Positions of the device shift as it drops writes, the contents are sent once
+        LOGGER_POST(LOG_WARNING, "Subscribe is not supported with the char device", &conn->addr, 0);
+#else
+        conn->subscribed = true;
+#endif
+    }
+
+    if (is_seekto || has_seekto)
+    {
+        if (connection_seek(conn, &seekto))
+        {
+            if (errno == ENOMEM)
+                return CONN_CLOSE;
+
+            LOGGER_POST(LOG_ERR, "IOCTL Error", NULL, errno);
+        }
+    }
+    else if (is_subscribe)
+    {
+        // Contents are sent from the start
+        conn->reply_offset = 0;
+    }
+    else
+    {
+        if (connection_append(conn, &iov, 1))
+            return CONN_CLOSE;
+
+        // Client has seen the bytes till its cursor in incremental mode, limited once committed
+        conn->reply_offset = server_config.incremental && !conn->commit_pending ? connection_read_cursor(conn) : 0;
+    }
+
+    conn->reply_pending = true;
+    conn->reply_len = 0;
+    conn->reply_sent = 0;
+    conn->reply_start_ns = metrics_now();
+
+    return CONN_DONE;
+}
+
+/**
+ * @brief   Processes the frames received in binary mode. The appends at the
+ *          head of the buffer are written together and replied with nothing,
+ *          any other frame is replied to on its own. An append the data file
+ *          can't take as a record stops the batch and is replied with
+ *          FRAME_STATUS_INVALID.
+ *
+ * @param   conn: Client connection, at least one frame is received.
+ * @param   parse_start_ns: Time the search for the frame has started.
+ *
+ * @return  Returns CONN_DONE on success and CONN_CLOSE on error.
+ */
+static int connection_process_frames(struct connection *conn, uint64_t parse_start_ns)
+{
+    struct frame_header header;
+    struct iovec iov[FRAME_MAX_BATCH];
+    char *payload = NULL;
+    bool rejected = false;
+    int num_appends = 0;
+    int iovcnt = 0;
+
+    while (num_appends < FRAME_MAX_BATCH && rx_frame_ready(&conn->rx, &header) > 0 &&
+           header.opcode == FRAME_OP_APPEND)
+    {
+        rx_next_frame(&conn->rx, &header, &payload);
+        num_appends++;
+
+        // Empty records are not written
+        if (header.length == 0)
+            continue;
+
+#if USE_AESD_CHAR_DEVICE
+        /*
+         * The driver commits a record once its '\n' is written, a record
+         * without it would be joined to the next one and any byte after it
+         * would start a new record
+         */
+        if (payload[header.length - 1] != '\n' || memchr(payload, '\n', header.length - 1))
+        {
+            rejected = true;
+            break;
+        }
+#endif
+
+        iov[iovcnt].iov_base = payload;
+        iov[iovcnt].iov_len = header.length;
+        iovcnt++;
+    }
+
+    if (num_appends)
+    {
+        metrics_latency(METRIC_PARSE, parse_start_ns);
+        metrics_add(METRIC_RECORDS, iovcnt);
+
+        if (iovcnt && connection_append(conn, iov, iovcnt))
+            return CONN_CLOSE;
+
+        // Sent once the records before it are written
+        if (rejected)
+            return connection_reply_frame(conn, FRAME_OP_APPEND, FRAME_STATUS_INVALID, NULL, 0, 0);
+
+        // Nothing to send, the reply only waits for the group commit
+        conn->reply_pending = true;
+        conn->reply_offset = 0;
+        conn->reply_end = 0;
+        conn->reply_len = 0;
+        conn->reply_sent = 0;
+        conn->reply_start_ns = metrics_now();
+
+        return CONN_DONE;
+    }
+
+    rx_next_frame(&conn->rx, &header, &payload);
+    metrics_latency(METRIC_PARSE, parse_start_ns);
+    metrics_add(METRIC_RECORDS, 1);
+
+    switch (header.opcode)
+    {
+    case FRAME_OP_SEEK:
+        return connection_frame_seek(conn, &header, payload);
+
+    case FRAME_OP_READ:
+        return connection_frame_read(conn, &header, payload);
+
+    case FRAME_OP_STAT:
+        return connection_frame_stat(conn);
+
+    default:
+        return connection_reply_frame(conn, header.opcode, FRAME_STATUS_INVALID, NULL, 0, 0);
+    }
+}
+
+/**
+ * @brief   Locates a record and an offset in it, replies with its position.
+ *
+ * @param   conn: Client connection.
+ * @param   header: Header of the frame.
+ * @param   payload: struct frame_seek.
+ *
+ * @return  Returns CONN_DONE.
+ */
+static int connection_frame_seek(struct connection *conn, const struct frame_header *header, const char *payload)
+{
+    struct frame_seek request;
+    struct aesd_seekto seekto;
+    uint64_t pos;
+
+    if (header->length != sizeof(request))
+        return connection_reply_frame(conn, FRAME_OP_SEEK, FRAME_STATUS_INVALID, NULL, 0, 0);
+
+    memcpy(&request, payload, sizeof(request));
+    seekto.write_cmd = be32toh(request.write_cmd);
+    seekto.write_cmd_offset = be32toh(request.write_cmd_offset);
+
+    if (connection_seek(conn, &seekto))
+        return connection_reply_frame(conn, FRAME_OP_SEEK,
+                                      errno == ENOMEM ? FRAME_STATUS_UNAVAILABLE : FRAME_STATUS_RANGE, NULL, 0, 0);
+
+    pos = htobe64(conn->reply_offset);
+
+    return connection_reply_frame(conn, FRAME_OP_SEEK, FRAME_STATUS_OK, &pos, sizeof(pos), 0);
+}
+
+/**
+ * @brief   Sets up the reply to a read, the range is trimmed to the end of
+ *          the data like pread(). With the char device or the ring store the range is
+ *          sent out of a snapshot, so the bytes announced are all sent.
+ *
+ * @param   conn: Client connection.
+ * @param   header: Header of the frame.
+ * @param   payload: struct frame_read.
+ *
+ * @return  Returns CONN_DONE.
+ */
+static int connection_frame_read(struct connection *conn, const struct frame_header *header, const char *payload)
+{
+    struct frame_read request;
+    uint64_t offset;
+    uint32_t length;
+    off_t data_size;
+
+    if (header->length != sizeof(request))
+        return connection_reply_frame(conn, FRAME_OP_READ, FRAME_STATUS_INVALID, NULL, 0, 0);
+
+    memcpy(&request, payload, sizeof(request));
+    offset = be64toh(request.offset);
+    length = be32toh(request.length);
+
+#if USE_AESD_CHAR_DEVICE || USE_AESD_RING_STORE
+    if (conn->snapshot == NULL)
+        conn->snapshot = store_snapshot_get();
+
+#if USE_AESD_CHAR_DEVICE
+    // Copy loop reads the device itself
+    data_size = conn->snapshot ? (off_t)conn->snapshot->size : lseek(conn->file_fd, 0, SEEK_END);
+#else
+    data_size = conn->snapshot ? (off_t)conn->snapshot->size : -1;
+#endif
+#else
+    data_size = store_size();
+#endif
+
+    if (data_size < 0)
+        return connection_reply_frame(conn, FRAME_OP_READ, FRAME_STATUS_UNAVAILABLE, NULL, 0, 0);
+
+    // Tail longer than the data starts at its beginning, nothing is read past its end
+    if (header->flags & FRAME_FLAG_FROM_END)
+        offset = offset < (uint64_t)data_size ? data_size - offset : 0;
+    else if (offset > (uint64_t)data_size)
+        offset = data_size;
+
+    if (length > data_size - offset)
+        length = data_size - offset;
+
+    conn->reply_offset = offset;
+
+    return connection_reply_frame(conn, FRAME_OP_READ, FRAME_STATUS_OK, NULL, 0, length);
+}
+
+/**
+ * @brief   Replies with the size of the data and the number of records in it.
+ *
+ * @param   conn: Client connection.
+ *
+ * @return  Returns CONN_DONE.
+ */
+static int connection_frame_stat(struct connection *conn)
+{
+    struct frame_stat stat = { 0 };
+#if USE_AESD_CHAR_DEVICE || USE_AESD_RING_STORE
+    struct store_snapshot *snapshot = store_snapshot_get();
+#if USE_AESD_CHAR_DEVICE
+    const char *data;
+#endif
+
+    if (snapshot == NULL)
+        return connection_reply_frame(conn, FRAME_OP_STAT, FRAME_STATUS_UNAVAILABLE, NULL, 0, 0);
+
+    stat.size = snapshot->size;
+#if USE_AESD_RING_STORE
+    stat.num_records = snapshot->num_records;
+#else
+    // Every write held by the device ends with '\n'
+    for (data = snapshot->data; (data = memchr(data, '\n', snapshot->data + snapshot->size - data)); data++)
+        stat.num_records++;
+#endif
+
+    store_snapshot_put(snapshot);
+#else
+    stat.size = store_size();
+    stat.num_records = store_records();
+#endif
+
+    stat.size = htobe64(stat.size);
+    stat.num_records = htobe32(stat.num_records);
+
+    return connection_reply_frame(conn, FRAME_OP_STAT, FRAME_STATUS_OK, &stat, sizeof(stat), 0);
+}
+
+/**
+ * @brief   Sets up a binary reply, the header and the payload are sent out of
+ *          the reply buffer and followed by data_len bytes of the data from
+ *          the reply offset.
+ *
+ * @param   conn: Client connection.
+ * @param   opcode: Opcode of the request.
+ * @param   status: Status of the request.
+ * @param   payload: Payload of the reply, NULL for none.
+ * @param   payload_len: Length of the payload.
+ * @param   data_len: Bytes of the data following the payload.
+ *
+ * @return  Returns CONN_DONE.
+ */
+static int connection_reply_frame(struct connection *conn, uint8_t opcode, uint8_t status, const void *payload,
+                                  uint32_t payload_len, uint32_t data_len)
+{
+    struct frame_header header = {
+        .opcode = opcode,
+        .status = status,
+        .length = htobe32(payload_len + data_len),
+    };
+
+    memcpy(conn->reply_buffer, &header, sizeof(header));
+
+    if (payload_len)
+        memcpy(conn->reply_buffer + sizeof(header), payload, payload_len);
+
+    conn->reply_pending = true;
+    conn->reply_end = conn->reply_offset + data_len;
+    conn->reply_len = sizeof(header) + payload_len;
+    conn->reply_sent = 0;
+    conn->reply_start_ns = metrics_now();
+
+    return CONN_DONE;
+}
+
+/**
+ * @brief   Writes records to the data file, or queues them for the group
+ *          commit in which case the reply waits for the last one.
+ *
+ * @param   conn: Client connection.
+ * @param   iov: Records to be written.
+ * @param   iovcnt: Number of records.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+static int connection_append(struct connection *conn, const struct iovec *iov, int iovcnt)
+{
+    uint64_t write_start_ns;
+    ssize_t ret_status = 0;
+    int i;
+
+    if (server_config.group_commit)
+    {
+        if (conn->commit_ticket == NULL && (conn->commit_ticket = commit_ticket_new()) == NULL)
+            return -1;
+
+        // Written by the committer along with the records of other clients
+        for (i = 0; i < iovcnt; i++)
+        {
+            if (commit_submit(conn->commit_ticket, iov[i].iov_base, iov[i].iov_len, &conn->commit_seq))
+                return -1;
+        }
+
+        conn->commit_pending = true;
+
+        return 0;
+    }
+
+    write_start_ns = metrics_now();
+#if USE_AESD_CHAR_DEVICE
+    for (i = 0; i < iovcnt; i++)
+    {
+        ret_status = write(conn->file_fd, iov[i].iov_base, iov[i].iov_len);
+
+        if (ret_status < 0)
+            break;
+    }
+
+    // Records written before a failure are visible as well
+    if (i > 0)
+        store_snapshot_invalidate();
+#else
+    ret_status = store_append(iov, iovcnt);
+#endif
+    metrics_latency(METRIC_WRITE, write_start_ns);
+
+    if (ret_status < 0)
+    {
+        LOGGER_POST(LOG_ERR, "Error while writing to the file", NULL, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Locates record X and offset Y in it, the reply offset is set to
+ *          its position. With the char device the driver seeks the data file,
+ *          with the ring store the record is located in the snapshot the
+ *          reply is sent from and with the store through its index.
+ *
+ * @param   conn: Client connection.
+ * @param   seekto: Record and offset to be located.
+ *
+ * @return  Returns 0 on success and -1 with errno set when the position does
+ *          not exist, the reply offset is then left at the start of the data
+ *          (or at the current position of the char device).
+ */
+static int connection_seek(struct connection *conn, const struct aesd_seekto *seekto)
+{
+#if USE_AESD_CHAR_DEVICE
+    int ret_status = ioctl(conn->file_fd, AESDCHAR_IOCSEEKTO, seekto);
+    int err = errno;
+
+    // Reply starts from the position the driver has seeked to
+    conn->reply_offset = lseek(conn->file_fd, 0, SEEK_CUR);
+
+    if (conn->reply_offset < 0)
+        conn->reply_offset = 0;
+
+    errno = err;
+
+    return ret_status;
+#else
+    conn->reply_offset = 0;
+
+#if USE_AESD_RING_STORE
+    if (conn->snapshot == NULL && (conn->snapshot = store_snapshot_get()) == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (store_snapshot_seek(conn->snapshot, seekto->write_cmd, seekto->write_cmd_offset, &conn->reply_offset))
+#else
+    if (store_seek(seekto->write_cmd, seekto->write_cmd_offset, &conn->reply_offset))
+#endif
+    {
+        conn->reply_offset = 0;
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+#endif
+}
+
+/**
+ * @brief   Parses "AESDCHAR_IOCSEEKTO:X,Y\n" command.
+ *
+ * @param   buffer: Received record including the '\n' character.
+ * @param   buffer_len: Length of the record.
+ * @param   seekto: Updated with X and Y values when the command is valid.
+ *
+ * @return  Returns 0 when the record is a valid command, 1 when it is not
+ *          the command and -1 when the command is malformed.
+ */
+static int parse_seekto(char *buffer, size_t buffer_len, struct aesd_seekto *seekto)
+{
+    if (buffer_len <= SEEKTO_CMD_LEN || memcmp(buffer, SEEKTO_CMD, SEEKTO_CMD_LEN))
+        return 1;
+
+    return parse_seekto_args(buffer, buffer_len, SEEKTO_CMD_LEN, seekto);
+}
+
+/**
+ * @brief   Parses "AESDCHAR_SUBSCRIBE\n" and "AESDCHAR_SUBSCRIBE:X,Y\n"
+ *          commands.
+ *
+ * @param   buffer: Received record including the '\n' character.
+ * @param   buffer_len: Length of the record.
+ * @param   seekto: Updated with X and Y values when they are given.
+ * @param   has_seekto: Set when X and Y are given.
+ *
+ * @return  Returns 0 when the record is a valid command, 1 when it is not
+ *          the command and -1 when the command is malformed.
+ */
+static int parse_subscribe(char *buffer, size_t buffer_len, struct aesd_seekto *seekto, bool *has_seekto)
+{
+    if (buffer_len <= SUBSCRIBE_CMD_LEN || memcmp(buffer, SUBSCRIBE_CMD, SUBSCRIBE_CMD_LEN))
+        return 1;
+
+    *has_seekto = buffer_len > SUBSCRIBE_CMD_LEN + 1;
+
+    if (!*has_seekto)
+        return 0;
+
+    // Any other record starting with the command is data
+    if (buffer[SUBSCRIBE_CMD_LEN] != ':')
+    {
+        *has_seekto = false;
+        return 1;
+    }
+
+    return parse_seekto_args(buffer, buffer_len, SUBSCRIBE_CMD_LEN + 1, seekto);
+}
+
+/**
+ * @brief   Parses "X,Y\n" arguments following the command. The arguments
+ *          are parsed from a copy, the record is left as received.
+ *
+ * @param   buffer: Received record including the '\n' character.
+ * @param   buffer_len: Length of the record.
+ * @param   cmd_len: Length of the command before X.
+ * @param   seekto: Updated with X and Y values when they are valid.
+ *
+ * @return  Returns 0 when the arguments are valid else -1.
+ */
+static int parse_seekto_args(char *buffer, size_t buffer_len, size_t cmd_len, struct aesd_seekto *seekto)
+{
+    char args[SEEKTO_ARGS_MAX_LEN + 1];
+    size_t args_len = buffer_len - 1 - cmd_len;
+    char *write_cmd;
+    char *write_offset;
+    char *end;
+
+    if (args_len > SEEKTO_ARGS_MAX_LEN || memchr(buffer + cmd_len, '\0', args_len))
+        return -1;
+
+    // Convert the arguments to string which ends with null character
+    memcpy(args, buffer + cmd_len, args_len);
+    args[args_len] = '\0';
+
+    // Get position of X which should be at the start of the arguments
+    write_cmd = args;
+
+    // Get position of Y which should be just after ','
+    write_offset = strchr(write_cmd, ',');
+
+    if (write_offset == NULL || write_offset == write_cmd)
+        return -1;
+
+    seekto->write_cmd = strtoul(write_cmd, &end, 10);
+
+    if (end != write_offset)
+        return -1;
+
+    write_offset++;
+
+    if (*write_offset == '\0')
+        return -1;
+
+    seekto->write_cmd_offset = strtoul(write_offset, &end, 10);
+
+    if (*end != '\0')
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief   Reads bytes from the client socket into the free space at the end
+ *          of the receive buffer, the buffer is compacted or grown when
+ *          less than BUFFER_MAX_SIZE bytes are free.
+ *
+ * @param   client_fd: Client file descriptor
+ * @param   rx: Receive buffer of the connection.
+ *
+ * @return  Returns number of bytes read. Returns -EAGAIN when a
+ *          non-blocking socket has no data and -1 on error or when the
+ *          client closed the connection.
+ */
+int sock_read(int client_fd, struct rx_buffer *rx)
+{
+    ssize_t buffer_len;
+
+    if (rx_reserve(rx, BUFFER_MAX_SIZE))
+    {
+        if (errno == ENOBUFS)
+            LOGGER_POST(LOG_WARNING, "Receive buffer budget exceeded, shedding", NULL, 0);
+        else
+            LOGGER_POST(LOG_ERR, "Error while allocating memmory to buffer", NULL, 0);
+
+        return -1;
+    }
+
+    buffer_len = read(client_fd, rx->data + rx->len, rx->cap - rx->len);
+
+    if (buffer_len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return -EAGAIN;
+
+    if (buffer_len < 0)
+    {
+        LOGGER_POST(LOG_ERR, "Error while getting data from the client", NULL, errno);
+        return -1;
+    }
+
+    // Client closed the connection
+    if (buffer_len == 0)
+        return -1;
+
+    rx->len += buffer_len;
+
+    return buffer_len;
+}
+
+/**
+ * @brief   Gets the next complete record from the receive buffer. Only the
+ *          bytes not searched by the previous calls are searched for '\n'.
+ *
+ * @param   rx: Receive buffer of the connection.
+ * @param   record: Set to the start of the record in the buffer.
+ * @param   record_len: Set to the length of the record including '\n'.
+ *
+ * @return  Returns true when a complete record is found. The record stays
+ *          valid until the next read into the buffer.
+ */
+static bool rx_next_record(struct rx_buffer *rx, char **record, size_t *record_len)
+{
+    size_t scan_from = rx->scanned > rx->start ? rx->scanned : rx->start;
+    char *newline = NULL;
+
+    if (scan_from < rx->len)
+        newline = memchr(rx->data + scan_from, '\n', rx->len - scan_from);
+
+    if (newline == NULL)
+    {
+        rx->scanned = rx->len;
+        return false;
+    }
+
+    *record = rx->data + rx->start;
+    *record_len = newline - *record + 1;
+
+    rx->start += *record_len;
+    rx->scanned = rx->start;
+
+    // All the received bytes are processed, next read starts from the beginning
+    if (rx->start == rx->len)
+    {
+        rx->start = 0;
+        rx->len = 0;
+        rx->scanned = 0;
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Checks if a complete frame is at the start of the unprocessed
+ *          bytes of the receive buffer.
+ *
+ * @param   rx: Receive buffer of the connection.
+ * @param   header: Set to the header, in host byte order, once received.
+ *
+ * @return  Returns 1 when the frame is complete, 0 when more bytes are to be
+ *          received and -1 when its payload exceeds FRAME_MAX_PAYLOAD.
+ */
+static int rx_frame_ready(const struct rx_buffer *rx, struct frame_header *header)
+{
+    size_t received = rx->len - rx->start;
+
+    if (received < sizeof(*header))
+        return 0;
+
+    // Header may not be aligned in the buffer
+    memcpy(header, rx->data + rx->start, sizeof(*header));
+    header->length = be32toh(header->length);
+
+    if (header->length > FRAME_MAX_PAYLOAD)
+        return -1;
+
+    return received - sizeof(*header) >= header->length;
+}
+
+/**
+ * @brief   Gets the next complete frame from the receive buffer.
+ *
+ * @param   rx: Receive buffer of the connection.
+ * @param   header: Set to the header of the frame in host byte order.
+ * @param   payload: Set to the start of the payload in the buffer.
+ *
+ * @return  Returns true when a complete frame is found. The payload stays
+ *          valid until the next read into the buffer.
+ */
+static bool rx_next_frame(struct rx_buffer *rx, struct frame_header *header, char **payload)
+{
+    if (rx_frame_ready(rx, header) <= 0)
+        return false;
+
+    *payload = rx->data + rx->start + sizeof(*header);
+
+    rx->start += sizeof(*header) + header->length;
+    rx->scanned = rx->start;
+
+    if (rx->start == rx->len)
+    {
+        rx->start = 0;
+        rx->len = 0;
+        rx->scanned = 0;
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Makes sure that at least min_free bytes are free at the end of
+ *          the receive buffer. Processed records are dropped by moving the
+ *          partial record to the start of the buffer, the buffer is doubled
+ *          when the partial record itself fills it. The growth is charged
+ *          to the receive buffer budgets.
+ *
+ * @param   rx: Receive buffer of the connection.
+ * @param   min_free: Number of bytes required to be free.
+ *
+ * @return  Returns 0 on success and -1 with errno set to ENOBUFS when a
+ *          budget is exceeded or ENOMEM when memory allocation fails.
+ */
+static int rx_reserve(struct rx_buffer *rx, size_t min_free)
+{
+    size_t new_cap;
+    char *new_data;
+
+    if (rx->cap - rx->len >= min_free)
+        return 0;
+
+    if (rx->start > 0)
+    {
+        memmove(rx->data, rx->data + rx->start, rx->len - rx->start);
+        rx->len -= rx->start;
+        rx->scanned -= rx->start;
+        rx->start = 0;
+
+        if (rx->cap - rx->len >= min_free)
+            return 0;
+    }
+
+    new_cap = rx->cap ? rx->cap : RX_BUFFER_INIT_SIZE;
+
+    while (new_cap - rx->len < min_free)
+        new_cap *= 2;
+
+    if (admission_charge(rx->cap, &new_cap, rx->len + min_free))
+        return -1;
+
+    new_data = realloc(rx->data, new_cap);
+
+    if (new_data == NULL)
+    {
+        admission_release(new_cap - rx->cap);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    rx->data = new_data;
+    rx->cap = new_cap;
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * @file    frame.h
+ * @brief   Binary framed protocol of aesdsocket, shared with aesdbench. A
+ *          client switches a connection to it by sending the text command
+ *          "AESDCHAR_BINARY\n", acknowledged with a FRAME_OP_HELLO frame.
+ *          Every frame after it starts with a header followed by length
+ *          bytes of payload, all the fields are in network byte order.
+ *
+ *          Frames are processed in order. Appends are not replied to, a
+ *          frame after them sees them all, so a client batches any number
+ *          of appends with a read or a stat in a single round trip. Records
+ *          are written as they are, no terminator is added.
+ *
+ *          With the char device (the default build) a record is only kept
+ *          once its '\n' is written, so the payload of an append must end
+ *          with a '\n' and hold no other one. Any other append is dropped
+ *          and replied with FRAME_STATUS_INVALID, the appends before it are
+ *          still written. The file and ring stores take any bytes.
+ *
+ *          Positions are offsets in the contents of the data, the ones
+ *          returned by FRAME_OP_SEEK. They shift once the oldest records are
+ *          dropped by the char device or the ring store.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+
+#define FRAME_CMD           ("AESDCHAR_BINARY")
+#define FRAME_CMD_LEN       (sizeof(FRAME_CMD) - 1)
+#define FRAME_VERSION       (1)
+#define FRAME_MAX_PAYLOAD   (16 << 20)
+
+enum frame_opcode
+{
+    FRAME_OP_HELLO = 0,     // Reply to the text command, payload is the version (uint32_t)
+    FRAME_OP_APPEND = 1,    // Payload is the record, no reply unless rejected
+    FRAME_OP_SEEK = 2,      // Payload is struct frame_seek, reply is the position (uint64_t)
+    FRAME_OP_READ = 3,      // Payload is struct frame_read, reply is the bytes read
+    FRAME_OP_STAT = 4,      // No payload, reply is struct frame_stat
+};
+
+enum frame_status
+{
+    FRAME_STATUS_OK = 0,
+    FRAME_STATUS_RANGE = 1,         // Record or offset to seek to is not in the data
+    FRAME_STATUS_INVALID = 2,       // Unknown opcode or payload of a wrong size
+    FRAME_STATUS_UNAVAILABLE = 3,   // Server failed to serve the request
+};
+
+// Offset of FRAME_OP_READ counts back from the end of the data
+#define FRAME_FLAG_FROM_END (1 << 0)
+
+struct frame_header
+{
+    uint8_t opcode;
+    uint8_t flags;          // Set in requests
+    uint8_t status;         // Set in replies
+    uint8_t reserved;
+    uint32_t length;        // Bytes of payload following the header
+};
+
+struct frame_seek
+{
+    uint32_t write_cmd;
+    uint32_t write_cmd_offset;
+};
+
+struct frame_read
+{
+    uint64_t offset;
+    uint32_t length;        // Trimmed to the end of the data, nothing past it
+    uint32_t reserved;
+};
+
+struct frame_stat
+{
+    uint64_t size;
+    uint32_t num_records;
+    uint32_t reserved;
+};
+
+#endif /* FRAME_H */
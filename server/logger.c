@@ -0,0 +1,459 @@
+/*******************************************************************************
+ * @file    logger.c
+ * @brief   Asynchronous logging of aesdsocket. Every thread posting records
+ *          owns a single producer, single consumer ring, a record is written
+ *          to the ring without locks or system calls. The writer thread
+ *          drains the rings, formats the records, converting the client
+ *          address only then, and writes them to stdout in batches and to
+ *          syslog.
+ *
+ *          A record posted to a full ring is dropped and counted, the writer
+ *          logs the number of dropped records. Records are written directly
+ *          when the writer thread is not running.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "logger.h"
+
+#define LOGGER_RING_SIZE    (512)       // Has to be a power of two
+#define LOGGER_BATCH_SIZE   (16 * 1024)
+#define LOGGER_LINE_SIZE    (256)
+#define LOGGER_IDLE_WAIT_MS (1000)
+
+struct logger_record
+{
+    const char *msg;
+    struct sockaddr_in addr;    // sin_family is 0 when there is no address
+    int level;
+    int err;
+};
+
+struct logger_ring
+{
+    struct logger_record records[LOGGER_RING_SIZE];
+    atomic_uint head;           // Next record to be posted, owner only
+    atomic_uint tail;           // Next record to be written, writer only
+    atomic_uint dropped;        // Records dropped as the ring was full
+    bool in_use;
+    struct logger_ring *next;
+};
+
+int logger_max_level = LOG_INFO;
+
+static __thread struct logger_ring *logger_local_ring;
+// Rings are only added at the head and never freed, the list past a head read under the lock is stable
+static struct logger_ring *ring_list;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer_thread_id;
+static atomic_bool writer_idle;
+static bool writer_running;
+static bool writer_stopping;
+
+static void *logger_thread(void *arg);
+static struct logger_ring *logger_rings_first(void);
+static struct logger_ring *logger_ring_get(void);
+static void logger_ring_release(void *ring_data);
+static bool logger_drain(char *batch, size_t *batch_len);
+static bool logger_rings_empty(void);
+static int logger_format(struct logger_record *record, char *line, size_t size);
+static void logger_flush(char *batch, size_t *batch_len);
+
+/**
+ * @brief   Starts the writer thread, records are written directly till then.
+ *
+ * @param   void
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int logger_start(void)
+{
+    int ret_status;
+
+    if (pthread_key_create(&ring_key, logger_ring_release))
+    {
+        printf("Failed to create logger key\n");
+        syslog(LOG_ERR, "Failed to create logger key");
+        return -1;
+    }
+
+    writer_stopping = false;
+
+    ret_status = pthread_create(&writer_thread_id, NULL, logger_thread, NULL);
+
+    if (ret_status != 0)
+    {
+        printf("Error while creating the logger thread: %s\n", strerror(ret_status));
+        syslog(LOG_ERR, "Error while creating the logger thread: %s", strerror(ret_status));
+        return -1;
+    }
+
+    writer_running = true;
+
+    return 0;
+}
+
+/**
+ * @brief   Writes all the posted records and stops the writer thread.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+void logger_stop(void)
+{
+    if (!writer_running)
+        return;
+
+    pthread_mutex_lock(&writer_lock);
+    writer_stopping = true;
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+
+    pthread_join(writer_thread_id, NULL);
+
+    writer_running = false;
+}
+
+/**
+ * @brief   Posts a record to the ring of the calling thread, use LOGGER_POST
+ *          to filter the records by level first.
+ *
+ * @param   level: syslog priority of the record.
+ * @param   msg: Message, has to stay valid till the record is written.
+ * @param   addr: Client address appended to the message, NULL for none.
+ * @param   err: errno value appended to the message, 0 for none.
+ *
+ * @return  void
+ */
+void logger_post(int level, const char *msg, const struct sockaddr_in *addr, int err)
+{
+    struct logger_ring *ring = logger_local_ring;
+    struct logger_record *record;
+    struct logger_record direct;
+    char line[LOGGER_LINE_SIZE];
+    unsigned int head;
+
+    if (ring == NULL && writer_running)
+        ring = logger_ring_get();
+
+    if (ring == NULL)
+    {
+        direct.msg = msg;
+        direct.level = level;
+        direct.err = err;
+        direct.addr.sin_family = 0;
+
+        if (addr)
+            direct.addr = *addr;
+
+        logger_format(&direct, line, sizeof(line));
+        fputs(line, stdout);
+        syslog(level, "%.*s", (int)strlen(line) - 1, line);
+        return;
+    }
+
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == LOGGER_RING_SIZE)
+    {
+        atomic_store_explicit(&ring->dropped, atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        return;
+    }
+
+    record = &ring->records[head & (LOGGER_RING_SIZE - 1)];
+    record->msg = msg;
+    record->level = level;
+    record->err = err;
+    record->addr.sin_family = 0;
+
+    if (addr)
+        record->addr = *addr;
+
+    // Published with a full barrier so that either the record or the idle writer is seen
+    atomic_store(&ring->head, head + 1);
+
+    if (atomic_load(&writer_idle))
+    {
+        pthread_mutex_lock(&writer_lock);
+        pthread_cond_signal(&writer_cond);
+        pthread_mutex_unlock(&writer_lock);
+    }
+}
+
+/**
+ * @brief   Writer thread, writes the posted records until stopped and all
+ *          the rings are drained.
+ *
+ * @param   arg: Unused.
+ *
+ * @return  void
+ */
+static void *logger_thread(void *arg)
+{
+    struct timespec deadline;
+    char *batch;
+    size_t batch_len = 0;
+    bool stopping = false;
+
+    batch = malloc(LOGGER_BATCH_SIZE);
+
+    if (batch == NULL)
+    {
+        printf("Error while allocating memmory to log batch\n");
+        syslog(LOG_ERR, "Error while allocating memmory to log batch");
+        return arg;
+    }
+
+    while (true)
+    {
+        if (logger_drain(batch, &batch_len))
+            continue;
+
+        logger_flush(batch, &batch_len);
+
+        if (stopping)
+            break;
+
+        // Sleep till a record is posted, rings are checked again once idle is visible
+        pthread_mutex_lock(&writer_lock);
+        atomic_store(&writer_idle, true);
+
+        if (logger_rings_empty() && !writer_stopping)
+        {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += LOGGER_IDLE_WAIT_MS / 1000;
+            pthread_cond_timedwait(&writer_cond, &writer_lock, &deadline);
+        }
+
+        atomic_store(&writer_idle, false);
+
+        // One more pass after stop is requested writes the last records
+        stopping = writer_stopping;
+        pthread_mutex_unlock(&writer_lock);
+    }
+
+    free(batch);
+
+    return arg;
+}
+
+/**
+ * @brief   Gets a ring for the calling thread, reusing the ring of an exited
+ *          thread when available.
+ *
+ * @param   void
+ *
+ * @return  Returns the ring or NULL when memory allocation fails.
+ */
+static struct logger_ring *logger_ring_get(void)
+{
+    struct logger_ring *ring;
+
+    pthread_mutex_lock(&ring_lock);
+
+    for (ring = ring_list; ring != NULL; ring = ring->next)
+    {
+        if (!ring->in_use)
+            break;
+    }
+
+    if (ring == NULL)
+    {
+        ring = calloc(1, sizeof(struct logger_ring));
+
+        if (ring != NULL)
+        {
+            ring->next = ring_list;
+            ring_list = ring;
+        }
+    }
+
+    if (ring != NULL)
+        ring->in_use = true;
+
+    pthread_mutex_unlock(&ring_lock);
+
+    if (ring == NULL)
+        return NULL;
+
+    // Ring is released by the key destructor when the thread exits
+    pthread_setspecific(ring_key, ring);
+    logger_local_ring = ring;
+
+    return ring;
+}
+
+/**
+ * @brief   Key destructor, makes the ring of an exiting thread available to
+ *          the next thread. Records left in it are still written.
+ *
+ * @param   ring_data: Ring of the exiting thread.
+ *
+ * @return  void
+ */
+static void logger_ring_release(void *ring_data)
+{
+    struct logger_ring *ring = (struct logger_ring *)ring_data;
+
+    pthread_mutex_lock(&ring_lock);
+    ring->in_use = false;
+    pthread_mutex_unlock(&ring_lock);
+}
+
+/**
+ * @brief   Gets the first ring of the list, the writer walks the list from it
+ *          without the lock so posting threads never wait on syslog.
+ *
+ * @param   void
+ *
+ * @return  Returns the first ring, NULL when there is none.
+ */
+static struct logger_ring *logger_rings_first(void)
+{
+    struct logger_ring *ring;
+
+    pthread_mutex_lock(&ring_lock);
+    ring = ring_list;
+    pthread_mutex_unlock(&ring_lock);
+
+    return ring;
+}
+
+/**
+ * @brief   Formats the records posted to all the rings into the batch and
+ *          writes them to syslog. Rings added meanwhile are drained by the
+ *          next call.
+ *
+ * @param   batch: Buffer of the lines to be written to stdout.
+ * @param   batch_len: Length of the lines in the batch.
+ *
+ * @return  Returns true when any record was written.
+ */
+static bool logger_drain(char *batch, size_t *batch_len)
+{
+    static unsigned int reported_dropped;
+    struct logger_ring *ring;
+    unsigned int head, tail;
+    unsigned int dropped = 0;
+    bool written = false;
+    int len;
+
+    for (ring = logger_rings_first(); ring != NULL; ring = ring->next)
+    {
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        for (tail = atomic_load_explicit(&ring->tail, memory_order_relaxed); tail != head; tail++)
+        {
+            if (*batch_len + LOGGER_LINE_SIZE > LOGGER_BATCH_SIZE)
+                logger_flush(batch, batch_len);
+
+            len = logger_format(&ring->records[tail & (LOGGER_RING_SIZE - 1)], batch + *batch_len,
+                                LOGGER_LINE_SIZE);
+
+            syslog(ring->records[tail & (LOGGER_RING_SIZE - 1)].level, "%.*s", len - 1, batch + *batch_len);
+            *batch_len += len;
+            written = true;
+        }
+
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+
+    if (dropped != reported_dropped)
+    {
+        printf("Dropped %u log records\n", dropped - reported_dropped);
+        syslog(LOG_WARNING, "Dropped %u log records", dropped - reported_dropped);
+        reported_dropped = dropped;
+    }
+
+    return written;
+}
+
+/**
+ * @brief   Checks if records are posted to any of the rings.
+ *
+ * @param   void
+ *
+ * @return  Returns true when all the rings are empty.
+ */
+static bool logger_rings_empty(void)
+{
+    struct logger_ring *ring;
+    bool empty = true;
+
+    for (ring = logger_rings_first(); ring != NULL && empty; ring = ring->next)
+        empty = atomic_load(&ring->head) == atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    return empty;
+}
+
+/**
+ * @brief   Formats the record as "<msg>[ <addr>][: <error>]\n".
+ *
+ * @param   record: Record to be formatted.
+ * @param   line: Buffer for the formatted line.
+ * @param   size: Size of the buffer.
+ *
+ * @return  Returns the length of the line including '\n'.
+ */
+static int logger_format(struct logger_record *record, char *line, size_t size)
+{
+    char addr_str[INET_ADDRSTRLEN] = "";
+    char err_str[128] = "";
+    int len;
+
+    if (record->addr.sin_family == AF_INET)
+        inet_ntop(AF_INET, &record->addr.sin_addr, addr_str, sizeof(addr_str));
+    else if (record->addr.sin_family == AF_UNIX)
+        strcpy(addr_str, "local");
+
+    if (record->err)
+        strerror_r(record->err, err_str, sizeof(err_str));
+
+    len = snprintf(line, size - 1, "%s%s%s%s%s", record->msg, addr_str[0] ? " " : "", addr_str,
+                   record->err ? ": " : "", err_str);
+
+    if (len > (int)size - 2)
+        len = size - 2;
+
+    line[len++] = '\n';
+    line[len] = '\0';
+
+    return len;
+}
+
+/**
+ * @brief   Writes the lines of the batch to stdout.
+ *
+ * @param   batch: Buffer of the lines.
+ * @param   batch_len: Length of the lines, reset to 0.
+ *
+ * @return  void
+ */
+static void logger_flush(char *batch, size_t *batch_len)
+{
+    if (*batch_len == 0)
+        return;
+
+    fwrite(batch, 1, *batch_len, stdout);
+    fflush(stdout);
+    *batch_len = 0;
+}
@@ -0,0 +1,35 @@
+/*******************************************************************************
+ * @file    logger.h
+ * @brief   Asynchronous logging of aesdsocket. Connection threads post fixed
+ *          size records to a ring of their own, a writer thread formats them
+ *          and writes them to stdout and syslog.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <syslog.h>
+#include <netinet/in.h>
+
+/*
+ * Posts a log record when its level passes the filter, nothing is evaluated
+ * or copied for filtered out records. msg has to be a string literal, addr
+ * is the client address or NULL and err is an errno value or 0.
+ */
+#define LOGGER_POST(level, msg, addr, err)              \
+    do                                                  \
+    {                                                   \
+        if ((level) <= logger_max_level)                \
+            logger_post((level), (msg), (addr), (err)); \
+    } while (0)
+
+extern int logger_max_level;
+
+int logger_start(void);
+void logger_stop(void);
+void logger_post(int level, const char *msg, const struct sockaddr_in *addr, int err);
+
+#endif /* LOGGER_H */
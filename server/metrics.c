@@ -0,0 +1,427 @@
+/*******************************************************************************
+ * @file    metrics.c
+ * @brief   Exports the metrics of aesdsocket. Shards of all the threads are
+ *          summed and written in plain text to every client connecting to
+ *          the metrics port on the loopback interface, the connection is
+ *          closed once the snapshot is sent. For example:
+ *
+ *              aesdsocket_connections_active 3
+ *              aesdsocket_write_ns{quantile="0.99"} 40959
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "aesdsocket.h"
+#include "metrics.h"
+
+#define METRICS_REPLY_SIZE  (16 * 1024)
+
+static const char *counter_names[NUM_METRIC_COUNTERS] = {
+    [METRIC_CONN_OPENED] = "connections_opened",
+    [METRIC_CONN_CLOSED] = "connections_closed",
+    [METRIC_RECORDS] = "records",
+    [METRIC_BYTES_IN] = "bytes_in",
+    [METRIC_BYTES_OUT] = "bytes_out",
+    [METRIC_SNAPSHOT_BUILDS] = "snapshot_builds",
+    [METRIC_SNAPSHOT_HITS] = "snapshot_hits",
+    [METRIC_CONN_REJECTED] = "connections_rejected",
+    [METRIC_CONN_SHED] = "connections_shed",
+    [METRIC_CONN_TIMED_OUT] = "connections_timed_out",
+};
+
+static const char *histogram_names[NUM_METRIC_HISTOGRAMS] = {
+    [METRIC_FIRST_BYTE] = "first_byte_ns",
+    [METRIC_PARSE] = "parse_ns",
+    [METRIC_WRITE] = "write_ns",
+    [METRIC_REPLY] = "reply_ns",
+    [METRIC_APPEND_WAIT] = "append_wait_ns",
+};
+
+static const char *quantile_names[] = { "0.5", "0.9", "0.99", "0.999" };
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+bool metrics_enabled;
+__thread struct metrics_shard *metrics_local_shard;
+
+static struct metrics_shard *shard_list;
+static pthread_mutex_t shard_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t shard_key;
+
+static pthread_t metrics_thread_id;
+static int metrics_fd = -1;
+
+static void *metrics_thread(void *arg);
+static void metrics_shard_release(void *shard_data);
+static void metrics_sum_counters(uint64_t *counters);
+static int metrics_format(char *buffer, size_t size);
+static uint64_t metrics_bucket_value(int bucket);
+
+/**
+ * @brief   Creates the metrics socket on the loopback interface, starts the
+ *          exporter thread and enables the collection of metrics.
+ *
+ * @param   port: Port of the metrics socket.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int metrics_start(int port)
+{
+    struct sockaddr_in addr;
+    int opt = 1;
+    int ret_status;
+
+    if (pthread_key_create(&shard_key, metrics_shard_release))
+    {
+        printf("Failed to create metrics key\n");
+        syslog(LOG_ERR, "Failed to create metrics key");
+        return -1;
+    }
+
+    metrics_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (metrics_fd < 0)
+    {
+        perror("Failed to create metrics socket");
+        syslog(LOG_ERR, "Failed to create metrics socket: %s", strerror(errno));
+        return -1;
+    }
+
+    setsockopt(metrics_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    if (bind(metrics_fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(metrics_fd, MAX_BACKLOGS))
+    {
+        printf("Failed to listen for metrics on port %d: %s\n", port, strerror(errno));
+        syslog(LOG_ERR, "Failed to listen for metrics on port %d: %s", port, strerror(errno));
+        close(metrics_fd);
+        metrics_fd = -1;
+        return -1;
+    }
+
+    metrics_enabled = true;
+
+    ret_status = pthread_create(&metrics_thread_id, NULL, metrics_thread, NULL);
+
+    if (ret_status != 0)
+    {
+        printf("Error while creating the metrics thread: %s\n", strerror(ret_status));
+        syslog(LOG_ERR, "Error while creating the metrics thread: %s", strerror(ret_status));
+        metrics_enabled = false;
+        close(metrics_fd);
+        metrics_fd = -1;
+        return -1;
+    }
+
+    printf("Exporting metrics on port %d\n", port);
+    syslog(LOG_INFO, "Exporting metrics on port %d", port);
+
+    return 0;
+}
+
+/**
+ * @brief   Stops the exporter thread and closes the metrics socket.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+void metrics_stop(void)
+{
+    if (metrics_fd < 0)
+        return;
+
+    // Exporter is woken up even when serving ended without a signal
+    eventfd_write(exit_event_fd, 1);
+    pthread_join(metrics_thread_id, NULL);
+
+    close(metrics_fd);
+    metrics_fd = -1;
+}
+
+/**
+ * @brief   Gets a shard for the calling thread, reusing the shard of an
+ *          exited thread when available.
+ *
+ * @param   void
+ *
+ * @return  Returns the shard or NULL when memory allocation fails.
+ */
+struct metrics_shard *metrics_shard_get(void)
+{
+    struct metrics_shard *shard;
+
+    pthread_mutex_lock(&shard_lock);
+
+    for (shard = shard_list; shard != NULL; shard = shard->next)
+    {
+        if (!shard->in_use)
+            break;
+    }
+
+    if (shard == NULL)
+    {
+        shard = calloc(1, sizeof(struct metrics_shard));
+
+        if (shard != NULL)
+        {
+            shard->next = shard_list;
+            shard_list = shard;
+        }
+    }
+
+    if (shard != NULL)
+        shard->in_use = true;
+
+    pthread_mutex_unlock(&shard_lock);
+
+    if (shard == NULL)
+        return NULL;
+
+    // Shard is released by the key destructor when the thread exits
+    pthread_setspecific(shard_key, shard);
+    metrics_local_shard = shard;
+
+    return shard;
+}
+
+/**
+ * @brief   Key destructor, makes the shard of an exiting thread available to
+ *          the next thread.
+ *
+ * @param   shard_data: Shard of the exiting thread.
+ *
+ * @return  void
+ */
+static void metrics_shard_release(void *shard_data)
+{
+    struct metrics_shard *shard = (struct metrics_shard *)shard_data;
+
+    pthread_mutex_lock(&shard_lock);
+    shard->in_use = false;
+    pthread_mutex_unlock(&shard_lock);
+}
+
+/**
+ * @brief   Exporter thread, sends a snapshot of the metrics to every client
+ *          of the metrics socket until exit is requested.
+ *
+ * @param   arg: Unused.
+ *
+ * @return  void
+ */
+static void *metrics_thread(void *arg)
+{
+    struct pollfd fds[2];
+    char *buffer;
+    int client_fd;
+    int len;
+    int sent;
+    int ret_status;
+
+    buffer = malloc(METRICS_REPLY_SIZE);
+
+    if (buffer == NULL)
+    {
+        printf("Error while allocating memmory to metrics buffer\n");
+        syslog(LOG_ERR, "Error while allocating memmory to metrics buffer");
+        return arg;
+    }
+
+    fds[0].fd = metrics_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = exit_event_fd;
+    fds[1].events = POLLIN;
+
+    while (!sig_exit_status)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("Error while waiting for metrics clients");
+            syslog(LOG_ERR, "Error while waiting for metrics clients: %s", strerror(errno));
+            break;
+        }
+
+        // Exit event stays readable once written
+        if (fds[1].revents & POLLIN)
+            break;
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        client_fd = accept(metrics_fd, NULL, NULL);
+
+        if (client_fd < 0)
+            continue;
+
+        len = metrics_format(buffer, METRICS_REPLY_SIZE);
+
+        for (sent = 0; sent < len; sent += ret_status)
+        {
+            ret_status = send(client_fd, buffer + sent, len - sent, MSG_NOSIGNAL);
+
+            if (ret_status <= 0)
+                break;
+        }
+
+        close(client_fd);
+    }
+
+    free(buffer);
+
+    return arg;
+}
+
+/**
+ * @brief   Timer job logging the totals of the counters, keeps a record of
+ *          the load in syslog without scraping the metrics port.
+ *
+ * @param   arg: Unused.
+ *
+ * @return  void
+ */
+void metrics_flush(void *arg)
+{
+    uint64_t counters[NUM_METRIC_COUNTERS];
+
+    pthread_mutex_lock(&shard_lock);
+    metrics_sum_counters(counters);
+    pthread_mutex_unlock(&shard_lock);
+
+    syslog(LOG_INFO, "Metrics: %" PRIu64 " active connections, %" PRIu64 " records, %" PRIu64
+           " bytes in, %" PRIu64 " bytes out", counters[METRIC_CONN_OPENED] - counters[METRIC_CONN_CLOSED],
+           counters[METRIC_RECORDS], counters[METRIC_BYTES_IN], counters[METRIC_BYTES_OUT]);
+}
+
+/**
+ * @brief   Sums the counters of all the shards, shard_lock has to be held.
+ *
+ * @param   counters: Set to the totals of the counters.
+ *
+ * @return  void
+ */
+static void metrics_sum_counters(uint64_t *counters)
+{
+    struct metrics_shard *shard;
+    int i;
+
+    memset(counters, 0, NUM_METRIC_COUNTERS * sizeof(uint64_t));
+
+    for (shard = shard_list; shard != NULL; shard = shard->next)
+    {
+        for (i = 0; i < NUM_METRIC_COUNTERS; i++)
+            counters[i] += atomic_load_explicit(&shard->counters[i], memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief   Sums the shards of all the threads and formats the metrics.
+ *
+ * @param   buffer: Buffer for the formatted metrics.
+ * @param   size: Size of the buffer.
+ *
+ * @return  Returns the length of the formatted metrics.
+ */
+static int metrics_format(char *buffer, size_t size)
+{
+    static uint64_t buckets[METRICS_NUM_BUCKETS];
+    uint64_t counters[NUM_METRIC_COUNTERS];
+    uint64_t count, sum, max, rank, seen;
+    struct metrics_shard *shard;
+    size_t len = 0;
+    int i, j, q;
+
+    pthread_mutex_lock(&shard_lock);
+
+    metrics_sum_counters(counters);
+
+    for (i = 0; i < NUM_METRIC_COUNTERS; i++)
+        len += snprintf(buffer + len, size - len, "aesdsocket_%s %" PRIu64 "\n", counter_names[i], counters[i]);
+
+    len += snprintf(buffer + len, size - len, "aesdsocket_connections_active %" PRIu64 "\n",
+                    counters[METRIC_CONN_OPENED] - counters[METRIC_CONN_CLOSED]);
+
+    for (i = 0; i < NUM_METRIC_HISTOGRAMS && len < size; i++)
+    {
+        memset(buckets, 0, sizeof(buckets));
+        count = sum = max = 0;
+
+        for (shard = shard_list; shard != NULL; shard = shard->next)
+        {
+            struct metrics_histogram_data *data = &shard->histograms[i];
+
+            for (j = 0; j < METRICS_NUM_BUCKETS; j++)
+                buckets[j] += atomic_load_explicit(&data->buckets[j], memory_order_relaxed);
+
+            sum += atomic_load_explicit(&data->sum, memory_order_relaxed);
+
+            if (atomic_load_explicit(&data->max, memory_order_relaxed) > max)
+                max = atomic_load_explicit(&data->max, memory_order_relaxed);
+        }
+
+        // Count is taken from the buckets so that the quantiles stay consistent
+        for (j = 0; j < METRICS_NUM_BUCKETS; j++)
+            count += buckets[j];
+
+        // Quantile is the upper bound of the bucket holding its rank
+        for (q = 0, j = 0, seen = 0; q < (int)(sizeof(quantiles) / sizeof(quantiles[0])) && len < size; q++)
+        {
+            rank = (uint64_t)(quantiles[q] * count + 0.5);
+
+            if (rank == 0)
+                rank = 1;
+
+            while (j < METRICS_NUM_BUCKETS - 1 && seen + buckets[j] < rank)
+                seen += buckets[j++];
+
+            len += snprintf(buffer + len, size - len, "aesdsocket_%s{quantile=\"%s\"} %" PRIu64 "\n",
+                            histogram_names[i], quantile_names[q], count ? metrics_bucket_value(j) : 0);
+        }
+
+        if (len < size)
+            len += snprintf(buffer + len, size - len,
+                            "aesdsocket_%s_count %" PRIu64 "\naesdsocket_%s_sum %" PRIu64 "\naesdsocket_%s_max %" PRIu64 "\n",
+                            histogram_names[i], count, histogram_names[i], sum, histogram_names[i], max);
+    }
+
+    pthread_mutex_unlock(&shard_lock);
+
+    return len < size ? len : size - 1;
+}
+
+/**
+ * @brief   Gets the largest value falling in the histogram bucket.
+ *
+ * @param   bucket: Index of the bucket.
+ *
+ * @return  Returns the upper bound of the bucket.
+ */
+static uint64_t metrics_bucket_value(int bucket)
+{
+    int shift;
+
+    if (bucket < METRICS_SUB_BUCKETS)
+        return bucket;
+
+    shift = bucket / METRICS_SUB_BUCKETS - 1;
+
+    return ((uint64_t)(METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS + 1) << shift) - 1;
+}
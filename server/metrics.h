@@ -0,0 +1,172 @@
+/*******************************************************************************
+ * @file    metrics.h
+ * @brief   Counters and latency histograms of aesdsocket. Every thread
+ *          updates its own shard without locks, the shards are only summed
+ *          when the metrics are exported.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/*
+ * Histogram buckets are log-linear as in HdrHistogram, values below 16 get a
+ * bucket each and every power of two above is split into 16 buckets. Relative
+ * error is below 1/16, values of 2^40 ns (about 18 minutes) and above share
+ * the last bucket.
+ */
+#define METRICS_SUB_BUCKET_BITS     (4)
+#define METRICS_SUB_BUCKETS         (1 << METRICS_SUB_BUCKET_BITS)
+#define METRICS_MAX_VALUE_BITS      (40)
+#define METRICS_NUM_BUCKETS         ((METRICS_MAX_VALUE_BITS - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS)
+
+enum metrics_counter
+{
+    METRIC_CONN_OPENED = 0,
+    METRIC_CONN_CLOSED,
+    METRIC_RECORDS,
+    METRIC_BYTES_IN,
+    METRIC_BYTES_OUT,
+    METRIC_SNAPSHOT_BUILDS,     // Reply snapshots read or copied from the store
+    METRIC_SNAPSHOT_HITS,       // Replies sharing an already built snapshot
+    METRIC_CONN_REJECTED,       // Connections above the connection cap
+    METRIC_CONN_SHED,           // Connections over a receive buffer budget
+    METRIC_CONN_TIMED_OUT,      // Connections past their read or write deadline
+    NUM_METRIC_COUNTERS,
+};
+
+enum metrics_histogram
+{
+    METRIC_FIRST_BYTE = 0,      // Accept to first byte received
+    METRIC_PARSE,               // Locating and parsing a record
+    METRIC_WRITE,               // Write of a record (or a commit batch)
+    METRIC_REPLY,               // Streaming a reply to the client
+    METRIC_APPEND_WAIT,         // Waiting for the store to grow or publish
+    NUM_METRIC_HISTOGRAMS,
+};
+
+struct metrics_histogram_data
+{
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+    atomic_uint_fast64_t buckets[METRICS_NUM_BUCKETS];
+};
+
+/**
+ * Metrics of a single thread. Only the owner thread updates the values, the
+ * exporter reads them with relaxed atomic loads. A shard is handed to a new
+ * thread once its owner exits, so the values are never lost.
+ */
+struct metrics_shard
+{
+    atomic_uint_fast64_t counters[NUM_METRIC_COUNTERS];
+    struct metrics_histogram_data histograms[NUM_METRIC_HISTOGRAMS];
+    bool in_use;
+    struct metrics_shard *next;
+};
+
+extern bool metrics_enabled;
+extern __thread struct metrics_shard *metrics_local_shard;
+
+int metrics_start(int port);
+void metrics_stop(void);
+void metrics_flush(void *arg);
+struct metrics_shard *metrics_shard_get(void);
+
+/**
+ * @brief   Updates a value owned by the calling thread, no atomic
+ *          read-modify-write is needed as there is a single writer.
+ */
+static inline void metrics_store_add(atomic_uint_fast64_t *value, uint64_t delta)
+{
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + delta,
+                          memory_order_relaxed);
+}
+
+/**
+ * @brief   Gets the monotonic time in nanoseconds, 0 when metrics are
+ *          disabled so that the timestamps are not recorded.
+ */
+static inline uint64_t metrics_now(void)
+{
+    struct timespec now;
+
+    if (!metrics_enabled)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief   Adds delta to the counter of the calling thread.
+ */
+static inline void metrics_add(enum metrics_counter counter, uint64_t delta)
+{
+    struct metrics_shard *shard = metrics_local_shard;
+
+    if (!metrics_enabled)
+        return;
+
+    if (shard == NULL && (shard = metrics_shard_get()) == NULL)
+        return;
+
+    metrics_store_add(&shard->counters[counter], delta);
+}
+
+/**
+ * @brief   Gets the histogram bucket of the value.
+ */
+static inline int metrics_bucket(uint64_t value)
+{
+    int msb;
+
+    if (value < METRICS_SUB_BUCKETS)
+        return value;
+
+    msb = 63 - __builtin_clzll(value);
+
+    if (msb >= METRICS_MAX_VALUE_BITS)
+        return METRICS_NUM_BUCKETS - 1;
+
+    return (msb - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS +
+           ((value >> (msb - METRICS_SUB_BUCKET_BITS)) & (METRICS_SUB_BUCKETS - 1));
+}
+
+/**
+ * @brief   Records the time elapsed since start_ns in the histogram of the
+ *          calling thread. Nothing is recorded when start_ns is 0.
+ */
+static inline void metrics_latency(enum metrics_histogram histogram, uint64_t start_ns)
+{
+    struct metrics_shard *shard = metrics_local_shard;
+    struct metrics_histogram_data *data;
+    uint64_t value;
+
+    if (!metrics_enabled || start_ns == 0)
+        return;
+
+    if (shard == NULL && (shard = metrics_shard_get()) == NULL)
+        return;
+
+    value = metrics_now() - start_ns;
+    data = &shard->histograms[histogram];
+
+    metrics_store_add(&data->buckets[metrics_bucket(value)], 1);
+    metrics_store_add(&data->count, 1);
+    metrics_store_add(&data->sum, value);
+
+    if (value > atomic_load_explicit(&data->max, memory_order_relaxed))
+        atomic_store_explicit(&data->max, value, memory_order_relaxed);
+}
+
+#endif /* METRICS_H */
@@ -0,0 +1,232 @@
+/*******************************************************************************
+ * @file    ratelimit.c
+ * @brief   Per-client rate limiting of aesdsocket. Every source address owns
+ *          a token bucket for the bytes it sends (-r) and one for the bytes
+ *          replied to it, shared by all of its connections so that opening
+ *          more connections does not raise its share.
+ *
+ *          Buckets hold up to one second worth of tokens. A transfer is
+ *          charged once done and may take the bucket below zero, the next
+ *          one waits until the debt is refilled, so records and replies of
+ *          any size pass and the rate still holds on average.
+ *
+ *          Clients are kept in a hash table by address and reference
+ *          counted by their connections, the table lock is only taken on
+ *          accept and close.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "aesdsocket.h"
+#include "logger.h"
+
+#define RATE_TABLE_SIZE     (256)
+#define NSEC_PER_SEC        (1000000000ULL)
+
+struct rate_bucket
+{
+    int64_t tokens;         // Bytes that can be transferred, negative when in debt
+    uint64_t refill_ns;     // Time of the last refill
+};
+
+struct rate_client
+{
+    struct in_addr addr;
+    int refs;
+    pthread_mutex_t lock;
+    struct rate_bucket buckets[NUM_RATE_DIRS];
+    struct rate_client *next;
+};
+
+static struct rate_client *rate_table[RATE_TABLE_SIZE];
+static pthread_mutex_t rate_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void ratelimit_refill(struct rate_bucket *bucket, uint64_t rate, uint64_t now_ns);
+
+/**
+ * @brief   Gets the current time on the monotonic clock.
+ *
+ * @param   void
+ *
+ * @return  Returns the time in nanoseconds.
+ */
+uint64_t ratelimit_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/**
+ * @brief   Gets a reference to the client of the address, created with full
+ *          buckets when it has no other connection.
+ *
+ * @param   addr: Source address of the connection.
+ *
+ * @return  Returns the client, NULL when no rate is configured or memory
+ *          allocation fails.
+ */
+struct rate_client *ratelimit_get(const struct sockaddr_in *addr)
+{
+    struct rate_client *client;
+    unsigned int slot = ntohl(addr->sin_addr.s_addr) % RATE_TABLE_SIZE;
+    uint64_t now_ns;
+
+    if (server_config.rate_in == 0 && server_config.rate_out == 0)
+        return NULL;
+
+    pthread_mutex_lock(&rate_table_lock);
+
+    for (client = rate_table[slot]; client != NULL; client = client->next)
+    {
+        if (client->addr.s_addr == addr->sin_addr.s_addr)
+        {
+            client->refs++;
+            pthread_mutex_unlock(&rate_table_lock);
+            return client;
+        }
+    }
+
+    client = malloc(sizeof(struct rate_client));
+
+    if (client == NULL)
+    {
+        pthread_mutex_unlock(&rate_table_lock);
+        LOGGER_POST(LOG_ERR, "Error while allocating memmory to rate limiter", addr, 0);
+        return NULL;
+    }
+
+    now_ns = ratelimit_now();
+
+    client->addr = addr->sin_addr;
+    client->refs = 1;
+    pthread_mutex_init(&client->lock, NULL);
+    client->buckets[RATE_IN].tokens = server_config.rate_in;
+    client->buckets[RATE_IN].refill_ns = now_ns;
+    client->buckets[RATE_OUT].tokens = server_config.rate_out;
+    client->buckets[RATE_OUT].refill_ns = now_ns;
+    client->next = rate_table[slot];
+    rate_table[slot] = client;
+
+    pthread_mutex_unlock(&rate_table_lock);
+
+    return client;
+}
+
+/**
+ * @brief   Releases a reference to the client, the last connection of the
+ *          address frees it.
+ *
+ * @param   client: Client returned by ratelimit_get().
+ *
+ * @return  void
+ */
+void ratelimit_put(struct rate_client *client)
+{
+    struct rate_client **link;
+    unsigned int slot = ntohl(client->addr.s_addr) % RATE_TABLE_SIZE;
+
+    pthread_mutex_lock(&rate_table_lock);
+
+    if (--client->refs == 0)
+    {
+        for (link = &rate_table[slot]; *link != client; link = &(*link)->next)
+            ;
+
+        *link = client->next;
+        pthread_mutex_destroy(&client->lock);
+        free(client);
+    }
+
+    pthread_mutex_unlock(&rate_table_lock);
+}
+
+/**
+ * @brief   Charges transferred bytes to a bucket of the client.
+ *
+ * @param   client: Client of the connection.
+ * @param   dir: RATE_IN for the bytes received, RATE_OUT for the replied ones.
+ * @param   bytes: Number of bytes transferred.
+ *
+ * @return  void
+ */
+void ratelimit_charge(struct rate_client *client, enum rate_dir dir, size_t bytes)
+{
+    pthread_mutex_lock(&client->lock);
+    client->buckets[dir].tokens -= bytes;
+    pthread_mutex_unlock(&client->lock);
+}
+
+/**
+ * @brief   Checks if the client may transfer in a direction.
+ *
+ * @param   client: Client of the connection.
+ * @param   dir: RATE_IN for the bytes received, RATE_OUT for the replied ones.
+ *
+ * @return  Returns 0 when the bucket has tokens, otherwise the monotonic
+ *          time in nanoseconds at which the debt is refilled.
+ */
+uint64_t ratelimit_resume_ns(struct rate_client *client, enum rate_dir dir)
+{
+    uint64_t rate = dir == RATE_IN ? server_config.rate_in : server_config.rate_out;
+    struct rate_bucket *bucket = &client->buckets[dir];
+    uint64_t now_ns, resume_ns = 0;
+
+    if (rate == 0)
+        return 0;
+
+    now_ns = ratelimit_now();
+
+    pthread_mutex_lock(&client->lock);
+
+    ratelimit_refill(bucket, rate, now_ns);
+
+    if (bucket->tokens < 0)
+        resume_ns = now_ns + (uint64_t)-bucket->tokens * NSEC_PER_SEC / rate + 1;
+
+    pthread_mutex_unlock(&client->lock);
+
+    return resume_ns;
+}
+
+/**
+ * @brief   Adds the tokens earned since the last refill, a bucket in debt is
+ *          repaid for all the time elapsed. The bucket is capped to one second
+ *          worth of tokens once the credit is added. Called with the client
+ *          lock held.
+ *
+ * @param   bucket: Bucket to be refilled.
+ * @param   rate: Rate of the bucket in bytes per second, at most UINT32_MAX.
+ * @param   now_ns: Current monotonic time.
+ *
+ * @return  void
+ */
+static void ratelimit_refill(struct rate_bucket *bucket, uint64_t rate, uint64_t now_ns)
+{
+    uint64_t elapsed_ns = now_ns - bucket->refill_ns;
+    uint64_t elapsed_s = elapsed_ns / NSEC_PER_SEC;
+    uint64_t earned;
+
+    // Whole seconds and the rest are credited apart, elapsed_ns * rate overflows past 4 seconds
+    earned = (elapsed_ns % NSEC_PER_SEC) * rate / NSEC_PER_SEC;
+
+    // Only the time of whole tokens is consumed, frequent refills lose nothing
+    bucket->refill_ns += elapsed_s * NSEC_PER_SEC + earned * NSEC_PER_SEC / rate;
+    bucket->tokens += elapsed_s * rate + earned;
+
+    if (bucket->tokens > (int64_t)rate)
+    {
+        bucket->tokens = rate;
+        bucket->refill_ns = now_ns;
+    }
+}
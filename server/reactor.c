@@ -0,0 +1,805 @@
+/*******************************************************************************
+ * @file    reactor.c
+ * @brief   Event driven connection handling for aesdsocket. A fixed set of
+ *          event loop threads, each with its own epoll instance, share the
+ *          non-blocking listening socket. Every loop accepts connections and
+ *          owns them until they are closed, driving the connection state
+ *          machine in edge-triggered mode. With shards every loop is pinned
+ *          to a core and listens on a listening socket of its shard. The
+ *          Unix domain listener, when enabled, is shared by all the loops.
+ *
+ *          A loop registers its broadcast eventfd with the store while it
+ *          serves subscribers, one signal per append resumes all of them.
+ *
+ *          Connections with events are queued on the ready queue of the loop
+ *          and served in deficit round robin order: every round adds the
+ *          quantum (-Q) to the deficit of a connection and its records and
+ *          replies are served until the bytes transferred use it up, so a
+ *          client with many pipelined records or large replies cannot hold
+ *          the loop. A connection over the rate of its client waits on the
+ *          throttled list, epoll_wait times out when the earliest of them
+ *          is due.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "aesdsocket.h"
+#include "logger.h"
+
+LIST_HEAD(connection_list_head_t, connection);
+STAILQ_HEAD(commit_wait_head_t, connection);
+STAILQ_HEAD(ready_queue_head_t, connection);
+
+struct event_loop
+{
+    pthread_t thread_id;
+    int epoll_fd;
+    int listen_fd;
+    int cpu;        // Core the loop is pinned to, -1 when not pinned
+    struct connection_list_head_t conn_list;
+
+    // Connections waiting for their record to be group committed
+    int commit_event_fd;
+    struct commit_wait_head_t commit_waiters;
+
+    // Subscribers pushed to when the broadcast eventfd is signalled
+    int broadcast_event_fd;
+    struct connection_list_head_t subscribers;
+    int num_subscribers;
+
+    // Connections with work left, served in deficit round robin order
+    struct ready_queue_head_t ready_queue;
+    int num_ready;
+
+    // Connections waiting for the rate of their client
+    struct connection_list_head_t throttled;
+};
+
+static void *event_loop_thread(void *loop_data);
+static void event_loop_accept(struct event_loop *loop, int listen_fd);
+static void event_loop_service(struct event_loop *loop, struct connection *conn, uint32_t events);
+static void event_loop_serve(struct event_loop *loop, struct connection *conn);
+static void event_loop_ready(struct event_loop *loop, struct connection *conn);
+static void event_loop_round(struct event_loop *loop);
+static void event_loop_throttle(struct event_loop *loop, struct connection *conn);
+static void event_loop_resume(struct event_loop *loop);
+static int event_loop_timeout(struct event_loop *loop);
+static void event_loop_drop(struct event_loop *loop, struct connection *conn);
+static void event_loop_commit_done(struct event_loop *loop);
+static int event_loop_subscribe(struct event_loop *loop, struct connection *conn);
+static void event_loop_push(struct event_loop *loop, struct connection *conn, uint32_t events);
+static void event_loop_broadcast(struct event_loop *loop);
+static int set_nonblocking(int fd);
+
+/**
+ * @brief   Starts num_loops event loop threads serving the listening sockets
+ *          and waits for them to exit. Loop i serves listening socket
+ *          i % num_listen_fds.
+ *
+ * @param   listen_fds: Listening sockets.
+ * @param   num_listen_fds: Number of listening sockets.
+ * @param   num_loops: Number of event loop threads to be created.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int reactor_run(int *listen_fds, int num_listen_fds, int num_loops)
+{
+    struct event_loop *loops;
+    struct epoll_event event;
+    int ret_status = 0;
+    int started = 0;
+    int i;
+
+    for (i = 0; i < num_listen_fds; i++)
+    {
+        if (set_nonblocking(listen_fds[i]))
+        {
+            perror("Failed to make listening socket non-blocking");
+            syslog(LOG_ERR, "Failed to make listening socket non-blocking: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    if (unix_listen_fd >= 0 && set_nonblocking(unix_listen_fd))
+    {
+        perror("Failed to make unix listening socket non-blocking");
+        syslog(LOG_ERR, "Failed to make unix listening socket non-blocking: %s", strerror(errno));
+        return -1;
+    }
+
+    loops = calloc(num_loops, sizeof(struct event_loop));
+
+    if (loops == NULL)
+    {
+        printf("Error while allocating memmory to event loops\n");
+        syslog(LOG_ERR, "Error while allocating memmory to event loops");
+        return -1;
+    }
+
+    for (i = 0; i < num_loops; i++)
+    {
+        loops[i].listen_fd = listen_fds[i % num_listen_fds];
+        loops[i].cpu = server_config.sharded ? i : -1;
+        loops[i].commit_event_fd = -1;
+        LIST_INIT(&loops[i].conn_list);
+        STAILQ_INIT(&loops[i].commit_waiters);
+        LIST_INIT(&loops[i].subscribers);
+        STAILQ_INIT(&loops[i].ready_queue);
+        LIST_INIT(&loops[i].throttled);
+
+        loops[i].epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+        if (loops[i].epoll_fd < 0)
+        {
+            perror("Failed to create epoll instance");
+            syslog(LOG_ERR, "Failed to create epoll instance: %s", strerror(errno));
+            ret_status = -1;
+            break;
+        }
+
+        // Only one of the loops is woken up for an incoming connection
+        event.events = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
+        event.data.ptr = NULL;
+
+        if (epoll_ctl(loops[i].epoll_fd, EPOLL_CTL_ADD, loops[i].listen_fd, &event))
+        {
+            perror("Failed to add listening socket to epoll");
+            syslog(LOG_ERR, "Failed to add listening socket to epoll: %s", strerror(errno));
+            close(loops[i].epoll_fd);
+            ret_status = -1;
+            break;
+        }
+
+        // Local clients are accepted by any of the loops
+        event.events = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
+        event.data.ptr = &unix_listen_fd;
+
+        if (unix_listen_fd >= 0 && epoll_ctl(loops[i].epoll_fd, EPOLL_CTL_ADD, unix_listen_fd, &event))
+        {
+            perror("Failed to add unix listening socket to epoll");
+            syslog(LOG_ERR, "Failed to add unix listening socket to epoll: %s", strerror(errno));
+            close(loops[i].epoll_fd);
+            ret_status = -1;
+            break;
+        }
+
+        // Exit event wakes up every loop
+        event.events = EPOLLIN;
+        event.data.ptr = &exit_event_fd;
+
+        if (epoll_ctl(loops[i].epoll_fd, EPOLL_CTL_ADD, exit_event_fd, &event))
+        {
+            perror("Failed to add exit event to epoll");
+            syslog(LOG_ERR, "Failed to add exit event to epoll: %s", strerror(errno));
+            close(loops[i].epoll_fd);
+            ret_status = -1;
+            break;
+        }
+
+        // Store signals the loop after every append while it has subscribers
+        loops[i].broadcast_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        event.events = EPOLLIN;
+        event.data.ptr = &loops[i].broadcast_event_fd;
+
+        if (loops[i].broadcast_event_fd < 0 ||
+            epoll_ctl(loops[i].epoll_fd, EPOLL_CTL_ADD, loops[i].broadcast_event_fd, &event))
+        {
+            perror("Failed to add broadcast event to epoll");
+            syslog(LOG_ERR, "Failed to add broadcast event to epoll: %s", strerror(errno));
+            if (loops[i].broadcast_event_fd >= 0)
+                close(loops[i].broadcast_event_fd);
+            close(loops[i].epoll_fd);
+            ret_status = -1;
+            break;
+        }
+
+        // Committer signals the loop after every flush
+        if (server_config.group_commit)
+        {
+            loops[i].commit_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            event.events = EPOLLIN;
+            event.data.ptr = &loops[i].commit_event_fd;
+
+            if (loops[i].commit_event_fd < 0 ||
+                epoll_ctl(loops[i].epoll_fd, EPOLL_CTL_ADD, loops[i].commit_event_fd, &event) ||
+                commit_add_notify(loops[i].commit_event_fd))
+            {
+                perror("Failed to add commit event to epoll");
+                syslog(LOG_ERR, "Failed to add commit event to epoll: %s", strerror(errno));
+                if (loops[i].commit_event_fd >= 0)
+                    close(loops[i].commit_event_fd);
+                close(loops[i].broadcast_event_fd);
+                close(loops[i].epoll_fd);
+                ret_status = -1;
+                break;
+            }
+        }
+
+        if (pthread_create(&loops[i].thread_id, NULL, event_loop_thread, &loops[i]))
+        {
+            perror("Error while creating the event loop thread");
+            syslog(LOG_ERR, "Error while creating the event loop thread: %s", strerror(errno));
+            if (loops[i].commit_event_fd >= 0)
+            {
+                commit_remove_notify(loops[i].commit_event_fd);
+                close(loops[i].commit_event_fd);
+            }
+            close(loops[i].broadcast_event_fd);
+            close(loops[i].epoll_fd);
+            ret_status = -1;
+            break;
+        }
+
+        started++;
+    }
+
+    printf("Serving connections from %d event loops\n", started);
+    syslog(LOG_INFO, "Serving connections from %d event loops", started);
+
+    // On partial start failure let the started loops exit as well
+    if (ret_status)
+        sig_exit_status = 1;
+
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(loops[i].thread_id, NULL);
+        close(loops[i].epoll_fd);
+        close(loops[i].broadcast_event_fd);
+
+        if (loops[i].commit_event_fd >= 0)
+        {
+            commit_remove_notify(loops[i].commit_event_fd);
+            close(loops[i].commit_event_fd);
+        }
+    }
+
+    free(loops);
+
+    return ret_status;
+}
+
+/**
+ * @brief   Event loop thread, waits for events on the listening socket and
+ *          on the connections owned by the loop until exit is requested.
+ *
+ * @param   loop_data: struct event_loop of this thread.
+ *
+ * @return  void
+ */
+static void *event_loop_thread(void *loop_data)
+{
+    struct event_loop *loop = (struct event_loop *)loop_data;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    struct connection *conn;
+    int num_events;
+    int i;
+
+    if (loop->cpu >= 0)
+        pin_thread_to_cpu(loop->cpu);
+
+    while (!sig_exit_status)
+    {
+        num_events = epoll_wait(loop->epoll_fd, events, MAX_EPOLL_EVENTS, event_loop_timeout(loop));
+
+        if (num_events < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("Error while waiting for events");
+            syslog(LOG_ERR, "Error while waiting for events: %s", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < num_events && !sig_exit_status; i++)
+        {
+            if (events[i].data.ptr == NULL)
+                event_loop_accept(loop, loop->listen_fd);
+            else if (events[i].data.ptr == &unix_listen_fd)
+                event_loop_accept(loop, unix_listen_fd);
+            else if (events[i].data.ptr == &loop->commit_event_fd)
+                event_loop_commit_done(loop);
+            else if (events[i].data.ptr == &loop->broadcast_event_fd)
+                event_loop_broadcast(loop);
+            else if (events[i].data.ptr != &exit_event_fd)
+                event_loop_service(loop, events[i].data.ptr, events[i].events);
+        }
+
+        if (sig_exit_status)
+            break;
+
+        event_loop_resume(loop);
+        event_loop_round(loop);
+    }
+
+    // Close all the connections still owned by the loop
+    while (!LIST_EMPTY(&loop->conn_list))
+    {
+        conn = LIST_FIRST(&loop->conn_list);
+        event_loop_drop(loop, conn);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief   Accepts all the pending connections on the listening socket and
+ *          registers them with the loop.
+ *
+ * @param   loop: Event loop accepting the connections.
+ * @param   listen_fd: Listening socket of the loop or the Unix domain one.
+ *
+ * @return  void
+ */
+static void event_loop_accept(struct event_loop *loop, int listen_fd)
+{
+    struct connection *conn;
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len;
+    struct epoll_event event;
+    int client_fd;
+
+    while (!sig_exit_status)
+    {
+        client_addr_len = sizeof(client_addr);
+        client_fd = accept4(listen_fd, (struct sockaddr *)&client_addr, &client_addr_len,
+                            SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (client_fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                LOGGER_POST(LOG_ERR, "Failed to connect to client", NULL, errno);
+
+            // Edge triggered, only stop once the backlog is drained
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            return;
+        }
+
+        conn = malloc(sizeof(struct connection));
+
+        if (conn == NULL)
+        {
+            LOGGER_POST(LOG_ERR, "Error while allocating memmory to connection", NULL, 0);
+            close(client_fd);
+            continue;
+        }
+
+        if (connection_init(conn, client_fd, &client_addr))
+        {
+            connection_close(conn);
+            free(conn);
+            continue;
+        }
+
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_fd, &event))
+        {
+            LOGGER_POST(LOG_ERR, "Failed to add connection to epoll", &conn->addr, errno);
+            connection_close(conn);
+            free(conn);
+            continue;
+        }
+
+        LIST_INSERT_HEAD(&loop->conn_list, conn, entries);
+    }
+}
+
+/**
+ * @brief   Handles the received events of a connection. Subscribers are
+ *          pushed to right away, other connections are queued to be served
+ *          in their turn.
+ *
+ * @param   loop: Event loop owning the connection.
+ * @param   conn: Connection for which events are received.
+ * @param   events: Received epoll events.
+ *
+ * @return  void
+ */
+static void event_loop_service(struct event_loop *loop, struct connection *conn, uint32_t events)
+{
+    // Resumed by event_loop_commit_done once the record is written and by
+    // event_loop_resume once the rate allows
+    if (conn->commit_queued || conn->throttle_listed)
+        return;
+
+    if (events & EPOLLERR)
+    {
+        event_loop_drop(loop, conn);
+        return;
+    }
+
+    if (conn->subscriber_listed)
+    {
+        event_loop_push(loop, conn, events);
+        return;
+    }
+
+    event_loop_ready(loop, conn);
+}
+
+/**
+ * @brief   Drives the connection state machine until the socket would block
+ *          or the deficit of the connection is used up, the connection is
+ *          queued again in the latter case. The connection is closed once no
+ *          more records are to be served.
+ *
+ * @param   loop: Event loop owning the connection.
+ * @param   conn: Connection taking its turn.
+ *
+ * @return  void
+ */
+static void event_loop_serve(struct event_loop *loop, struct connection *conn)
+{
+    int ret_status;
+
+    while (true)
+    {
+        if (conn->deficit <= 0)
+        {
+            event_loop_ready(loop, conn);
+            return;
+        }
+
+        if (conn->reply_pending)
+        {
+            ret_status = connection_write(conn);
+
+            if (ret_status == CONN_AGAIN)
+                break;
+
+            if (ret_status == CONN_COMMIT)
+            {
+                conn->commit_queued = true;
+                STAILQ_INSERT_TAIL(&loop->commit_waiters, conn, commit_entries);
+                break;
+            }
+
+            if (ret_status == CONN_THROTTLED)
+            {
+                event_loop_throttle(loop, conn);
+                break;
+            }
+
+            if (ret_status == CONN_CLOSE ||
+                (!server_config.keep_alive && !conn->binary && !connection_has_record(conn)))
+            {
+                event_loop_drop(loop, conn);
+                return;
+            }
+        }
+
+        ret_status = connection_read(conn);
+
+        if (ret_status == CONN_AGAIN)
+            break;
+
+        if (ret_status == CONN_THROTTLED)
+        {
+            event_loop_throttle(loop, conn);
+            break;
+        }
+
+        if (ret_status == CONN_CLOSE)
+        {
+            event_loop_drop(loop, conn);
+            return;
+        }
+
+        // Listed before the first reply so that no append is missed
+        if (conn->subscribed)
+        {
+            if (event_loop_subscribe(loop, conn))
+                event_loop_drop(loop, conn);
+            else
+                event_loop_push(loop, conn, 0);
+
+            return;
+        }
+    }
+
+    // Credit is not kept while waiting, debt is
+    if (conn->deficit > 0)
+        conn->deficit = 0;
+}
+
+/**
+ * @brief   Queues the connection at the tail of the ready queue.
+ *
+ * @param   loop: Event loop owning the connection.
+ * @param   conn: Connection with work left.
+ *
+ * @return  void
+ */
+static void event_loop_ready(struct event_loop *loop, struct connection *conn)
+{
+    if (conn->ready_queued)
+        return;
+
+    conn->ready_queued = true;
+    STAILQ_INSERT_TAIL(&loop->ready_queue, conn, ready_entries);
+    loop->num_ready++;
+}
+
+/**
+ * @brief   Gives every connection on the ready queue one turn with the
+ *          quantum added to its deficit. Connections queued again during
+ *          the round take their next turn in the next round.
+ *
+ * @param   loop: Event loop.
+ *
+ * @return  void
+ */
+static void event_loop_round(struct event_loop *loop)
+{
+    struct connection *conn;
+    int num_turns = loop->num_ready;
+
+    while (num_turns-- > 0 && !sig_exit_status)
+    {
+        conn = STAILQ_FIRST(&loop->ready_queue);
+        STAILQ_REMOVE_HEAD(&loop->ready_queue, ready_entries);
+        conn->ready_queued = false;
+        loop->num_ready--;
+
+        conn->deficit += server_config.quantum;
+        event_loop_serve(loop, conn);
+    }
+}
+
+/**
+ * @brief   Parks a connection over the rate of its client until its
+ *          resume time.
+ *
+ * @param   loop: Event loop owning the connection.
+ * @param   conn: Throttled connection.
+ *
+ * @return  void
+ */
+static void event_loop_throttle(struct event_loop *loop, struct connection *conn)
+{
+    if (conn->throttle_listed)
+        return;
+
+    conn->throttle_listed = true;
+    LIST_INSERT_HEAD(&loop->throttled, conn, throttled_entries);
+}
+
+/**
+ * @brief   Resumes the throttled connections whose resume time has passed.
+ *
+ * @param   loop: Event loop.
+ *
+ * @return  void
+ */
+static void event_loop_resume(struct event_loop *loop)
+{
+    struct connection *conn, *next_conn;
+    uint64_t now_ns;
+
+    if (LIST_EMPTY(&loop->throttled))
+        return;
+
+    now_ns = ratelimit_now();
+
+    for (conn = LIST_FIRST(&loop->throttled); conn != NULL; conn = next_conn)
+    {
+        next_conn = LIST_NEXT(conn, throttled_entries);
+
+        if (conn->resume_ns > now_ns)
+            continue;
+
+        LIST_REMOVE(conn, throttled_entries);
+        conn->throttle_listed = false;
+
+        event_loop_service(loop, conn, 0);
+    }
+}
+
+/**
+ * @brief   Gets the timeout of epoll_wait, the loop does not block while
+ *          connections are ready and wakes up for the earliest throttled one.
+ *
+ * @param   loop: Event loop.
+ *
+ * @return  Returns the timeout in milliseconds, -1 for none.
+ */
+static int event_loop_timeout(struct event_loop *loop)
+{
+    struct connection *conn;
+    uint64_t now_ns, resume_ns = UINT64_MAX;
+
+    if (loop->num_ready)
+        return 0;
+
+    if (LIST_EMPTY(&loop->throttled))
+        return -1;
+
+    LIST_FOREACH(conn, &loop->throttled, throttled_entries)
+    {
+        if (conn->resume_ns < resume_ns)
+            resume_ns = conn->resume_ns;
+    }
+
+    now_ns = ratelimit_now();
+
+    if (resume_ns <= now_ns)
+        return 0;
+
+    return (resume_ns - now_ns + 999999) / 1000000;
+}
+
+/**
+ * @brief   Adds the connection to the subscribers of the loop, the loop is
+ *          registered for the broadcast with its first subscriber.
+ *
+ * @param   loop: Event loop owning the connection.
+ * @param   conn: Subscribed connection.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+static int event_loop_subscribe(struct event_loop *loop, struct connection *conn)
+{
+    if (loop->num_subscribers == 0 && broadcast_add_notify(loop->broadcast_event_fd))
+        return -1;
+
+    loop->num_subscribers++;
+    LIST_INSERT_HEAD(&loop->subscribers, conn, subscriber_entries);
+    conn->subscriber_listed = true;
+
+    return 0;
+}
+
+/**
+ * @brief   Pushes the new records to a subscriber, bytes sent by the client
+ *          are dropped.
+ *
+ * @param   loop: Event loop owning the connection.
+ * @param   conn: Subscribed connection.
+ * @param   events: Received epoll events, 0 when signalled by the store.
+ *
+ * @return  void
+ */
+static void event_loop_push(struct event_loop *loop, struct connection *conn, uint32_t events)
+{
+    int ret_status;
+
+    // Resumed by event_loop_resume once the rate allows
+    if (conn->throttle_listed)
+        return;
+
+    // Subscription outlives the write side of the client
+    if ((events & EPOLLHUP) ||
+        ((events & (EPOLLIN | EPOLLRDHUP)) && connection_discard(conn) == CONN_CLOSE))
+    {
+        event_loop_drop(loop, conn);
+        return;
+    }
+
+    ret_status = connection_push(conn);
+
+    if (ret_status == CONN_THROTTLED)
+        event_loop_throttle(loop, conn);
+    else if (ret_status == CONN_CLOSE)
+        event_loop_drop(loop, conn);
+}
+
+/**
+ * @brief   Pushes the appended records to all the subscribers of the loop.
+ *
+ * @param   loop: Event loop signalled by the store.
+ *
+ * @return  void
+ */
+static void event_loop_broadcast(struct event_loop *loop)
+{
+    struct connection *conn, *next_conn;
+    eventfd_t value;
+
+    eventfd_read(loop->broadcast_event_fd, &value);
+
+    for (conn = LIST_FIRST(&loop->subscribers); conn != NULL; conn = next_conn)
+    {
+        next_conn = LIST_NEXT(conn, subscriber_entries);
+        event_loop_push(loop, conn, 0);
+    }
+}
+
+/**
+ * @brief   Resumes the connections whose records are written by the group
+ *          commit. Records of a loop are queued in order, hence waiters are
+ *          resumed from the head until one is still pending.
+ *
+ * @param   loop: Event loop signalled by the committer.
+ *
+ * @return  void
+ */
+static void event_loop_commit_done(struct event_loop *loop)
+{
+    struct connection *conn;
+    eventfd_t value;
+
+    eventfd_read(loop->commit_event_fd, &value);
+
+    while (!STAILQ_EMPTY(&loop->commit_waiters))
+    {
+        conn = STAILQ_FIRST(&loop->commit_waiters);
+
+        if (commit_status(conn->commit_ticket, conn->commit_seq) == 0)
+            break;
+
+        STAILQ_REMOVE_HEAD(&loop->commit_waiters, commit_entries);
+        conn->commit_queued = false;
+
+        event_loop_service(loop, conn, 0);
+    }
+}
+
+/**
+ * @brief   Removes the connection from the loop, closes and frees it.
+ *
+ * @param   loop: Event loop owning the connection.
+ * @param   conn: Connection to be closed.
+ *
+ * @return  void
+ */
+static void event_loop_drop(struct event_loop *loop, struct connection *conn)
+{
+    if (conn->commit_queued)
+        STAILQ_REMOVE(&loop->commit_waiters, conn, connection, commit_entries);
+
+    if (conn->ready_queued)
+    {
+        STAILQ_REMOVE(&loop->ready_queue, conn, connection, ready_entries);
+        loop->num_ready--;
+    }
+
+    if (conn->throttle_listed)
+        LIST_REMOVE(conn, throttled_entries);
+
+    if (conn->subscriber_listed)
+    {
+        LIST_REMOVE(conn, subscriber_entries);
+
+        if (--loop->num_subscribers == 0)
+            broadcast_remove_notify(loop->broadcast_event_fd);
+    }
+
+    LIST_REMOVE(conn, entries);
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->sock_fd, NULL);
+    connection_close(conn);
+    free(conn);
+}
+
+/**
+ * @brief   Sets O_NONBLOCK flag on the file descriptor.
+ *
+ * @param   fd: File descriptor.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    if (flags < 0)
+        return -1;
+
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
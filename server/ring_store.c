@@ -0,0 +1,344 @@
+/*******************************************************************************
+ * @file    ring_store.c
+ * @brief   In-process record store of aesdsocket built with RING_STORE=1.
+ *          Keeps the last AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED records in
+ *          the circular buffer of the aesdchar driver, linked in userspace,
+ *          so the "last N writes" semantics of /dev/aesdchar are kept
+ *          without a system call per record.
+ *
+ *          Records are copied before the ring lock is taken. Every append
+ *          bumps the generation of the ring. Replies are sent out of a
+ *          snapshot, the ring contents copied end to end along with the end
+ *          offset of every record, and "AESDCHAR_IOCSEEKTO:X,Y" is located in
+ *          it. The snapshot is built by the first client replying after an
+ *          append and shared by all the clients replying at the same
+ *          generation. A snapshot is reference counted and freed once the
+ *          last connection sending it is done.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "aesdsocket.h"
+#include "metrics.h"
+#include "logger.h"
+
+#define RING_MAX_RECORDS    AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
+
+static struct aesd_circular_buffer ring;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Bumped by every append under ring_lock, size is read without the lock
+static atomic_uint_fast64_t ring_generation;
+static atomic_size_t ring_size;
+
+// Bytes ever appended, subscriber cursors are kept relative to it
+static uint64_t ring_stream_end;
+
+// Latest snapshot, only swapped and referenced under snapshot_lock
+static struct store_snapshot *ring_snapshot;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct store_snapshot *ring_snapshot_cached(uint64_t generation);
+static struct store_snapshot *ring_snapshot_build(void);
+
+/**
+ * @brief   Initializes the ring.
+ *
+ * @param   path: Unused, the records are kept in memory only.
+ *
+ * @return  Returns 0.
+ */
+int store_open(const char *path)
+{
+    aesd_circular_buffer_init(&ring);
+
+    atomic_init(&ring_generation, 0);
+    atomic_init(&ring_size, 0);
+    ring_stream_end = 0;
+
+    return 0;
+}
+
+/**
+ * @brief   Frees the records held by the ring and drops the published
+ *          snapshot.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+void store_close(void)
+{
+    struct aesd_buffer_entry *entry;
+    uint32_t index;
+
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &ring, index)
+    {
+        free((char *)entry->buffptr);
+    }
+
+    aesd_circular_buffer_free(&ring);
+
+    if (ring_snapshot)
+    {
+        store_snapshot_put(ring_snapshot);
+        ring_snapshot = NULL;
+    }
+}
+
+/**
+ * @brief   Adds records to the ring, every buffer holds one record. The
+ *          oldest records are dropped once the ring is full.
+ *
+ * @param   iov: Records to be appended.
+ * @param   iovcnt: Number of records.
+ *
+ * @return  Returns 0 on success and -1 with errno set on error.
+ */
+int store_append(const struct iovec *iov, int iovcnt)
+{
+    struct aesd_buffer_entry entries[RING_MAX_RECORDS];
+    struct aesd_buffer_entry removed;
+    const char *dropped[RING_MAX_RECORDS];
+    uint64_t wait_start_ns;
+    size_t size;
+    int num_entries = 0;
+    int num_dropped = 0;
+    int first, i;
+
+    // Records before the last RING_MAX_RECORDS would be dropped by this append itself
+    first = iovcnt > RING_MAX_RECORDS ? iovcnt - RING_MAX_RECORDS : 0;
+
+    for (i = first; i < iovcnt; i++, num_entries++)
+    {
+        entries[num_entries].size = iov[i].iov_len;
+        entries[num_entries].buffptr = malloc(iov[i].iov_len);
+
+        if (entries[num_entries].buffptr == NULL)
+        {
+            while (num_entries--)
+                free((char *)entries[num_entries].buffptr);
+
+            errno = ENOMEM;
+            return -1;
+        }
+
+        memcpy((char *)entries[num_entries].buffptr, iov[i].iov_base, iov[i].iov_len);
+    }
+
+    wait_start_ns = metrics_now();
+    pthread_mutex_lock(&ring_lock);
+    metrics_latency(METRIC_APPEND_WAIT, wait_start_ns);
+
+    size = atomic_load_explicit(&ring_size, memory_order_relaxed);
+
+    for (i = 0; i < num_entries; i++)
+    {
+        // Oldest record is overwritten, freed once the lock is released
+        if (ring.full && aesd_circular_buffer_remove_entry(&ring, &removed))
+        {
+            dropped[num_dropped++] = removed.buffptr;
+            size -= removed.size;
+        }
+
+        aesd_circular_buffer_add_entry(&ring, &entries[i]);
+        size += entries[i].size;
+    }
+
+    for (i = 0; i < iovcnt; i++)
+        ring_stream_end += iov[i].iov_len;
+
+    atomic_store_explicit(&ring_size, size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ring_generation, 1, memory_order_release);
+
+    pthread_mutex_unlock(&ring_lock);
+
+    for (i = 0; i < num_dropped; i++)
+        free((char *)dropped[i]);
+
+    broadcast_publish();
+
+    return 0;
+}
+
+/**
+ * @brief   Gets the number of bytes held by the ring.
+ *
+ * @param   void
+ *
+ * @return  Returns the size of the data.
+ */
+off_t store_size(void)
+{
+    return atomic_load_explicit(&ring_size, memory_order_relaxed);
+}
+
+/**
+ * @brief   Gets a reference to a snapshot holding at least all the appends
+ *          completed before the call, it stays valid until released with
+ *          store_snapshot_put(). The cached snapshot is shared when its
+ *          generation matches, otherwise the ring is copied into a new one.
+ *
+ * @param   void
+ *
+ * @return  Returns the snapshot or NULL when memory allocation fails.
+ */
+struct store_snapshot *store_snapshot_get(void)
+{
+    struct store_snapshot *snapshot, *old_snapshot;
+
+    snapshot = ring_snapshot_cached(atomic_load_explicit(&ring_generation, memory_order_acquire));
+
+    if (snapshot)
+        return snapshot;
+
+    pthread_mutex_lock(&ring_lock);
+
+    // Snapshot may have been built while waiting for the lock
+    snapshot = ring_snapshot_cached(atomic_load_explicit(&ring_generation, memory_order_relaxed));
+
+    if (snapshot == NULL)
+    {
+        snapshot = ring_snapshot_build();
+
+        if (snapshot)
+        {
+            pthread_mutex_lock(&snapshot_lock);
+            old_snapshot = ring_snapshot;
+            ring_snapshot = snapshot;
+            pthread_mutex_unlock(&snapshot_lock);
+
+            if (old_snapshot)
+                store_snapshot_put(old_snapshot);
+        }
+    }
+
+    pthread_mutex_unlock(&ring_lock);
+
+    return snapshot;
+}
+
+/**
+ * @brief   Releases a reference to the snapshot, the last one frees it.
+ *
+ * @param   snapshot: Snapshot returned by store_snapshot_get().
+ *
+ * @return  void
+ */
+void store_snapshot_put(struct store_snapshot *snapshot)
+{
+    if (atomic_fetch_sub_explicit(&snapshot->refs, 1, memory_order_acq_rel) == 1)
+        free(snapshot);
+}
+
+/**
+ * @brief   Gets the position of the byte at an offset in a record of the
+ *          snapshot, same as AESDCHAR_IOCSEEKTO on the driver.
+ *
+ * @param   snapshot: Snapshot the reply is sent from.
+ * @param   record: Number of the record, 0 for the oldest one in the ring.
+ * @param   record_offset: Offset of the byte in the record.
+ * @param   pos: Set to the position of the byte in the snapshot.
+ *
+ * @return  Returns 0 on success and -1 when the record or the offset does
+ *          not exist.
+ */
+int store_snapshot_seek(const struct store_snapshot *snapshot, uint32_t record, uint32_t record_offset,
+                        off_t *pos)
+{
+    size_t start;
+
+    if (record >= snapshot->num_records)
+        return -1;
+
+    start = record ? snapshot->record_ends[record - 1] : 0;
+
+    if (record_offset >= snapshot->record_ends[record] - start)
+        return -1;
+
+    *pos = start + record_offset;
+
+    return 0;
+}
+
+/**
+ * @brief   Gets a reference to the cached snapshot when it is of the given
+ *          generation.
+ *
+ * @param   generation: Generation the snapshot has to match.
+ *
+ * @return  Returns the snapshot or NULL when it is stale or missing.
+ */
+static struct store_snapshot *ring_snapshot_cached(uint64_t generation)
+{
+    struct store_snapshot *snapshot = NULL;
+
+    pthread_mutex_lock(&snapshot_lock);
+
+    if (ring_snapshot && ring_snapshot->generation == generation)
+    {
+        snapshot = ring_snapshot;
+        atomic_fetch_add_explicit(&snapshot->refs, 1, memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(&snapshot_lock);
+
+    if (snapshot)
+        metrics_add(METRIC_SNAPSHOT_HITS, 1);
+
+    return snapshot;
+}
+
+/**
+ * @brief   Copies the records of the ring end to end, from the oldest one,
+ *          into a new snapshot. Called with ring_lock held.
+ *
+ * @param   void
+ *
+ * @return  Returns the snapshot, holding a reference for the caller and one
+ *          for the cache, or NULL when memory allocation fails.
+ */
+static struct store_snapshot *ring_snapshot_build(void)
+{
+    struct store_snapshot *snapshot;
+    uint32_t index;
+
+    snapshot = malloc(sizeof(struct store_snapshot) + atomic_load_explicit(&ring_size, memory_order_relaxed));
+
+    if (snapshot == NULL)
+    {
+        LOGGER_POST(LOG_ERR, "Error while allocating memmory to snapshot", NULL, 0);
+        return NULL;
+    }
+
+    metrics_add(METRIC_SNAPSHOT_BUILDS, 1);
+
+    atomic_init(&snapshot->refs, 2);
+    snapshot->generation = atomic_load_explicit(&ring_generation, memory_order_relaxed);
+    snapshot->stream_end = ring_stream_end;
+    snapshot->size = 0;
+    snapshot->num_records = 0;
+
+    if (ring.count == 0)
+        return snapshot;
+
+    index = ring.out_offs;
+
+    do
+    {
+        memcpy(snapshot->data + snapshot->size, ring.entry[index].buffptr, ring.entry[index].size);
+        snapshot->size += ring.entry[index].size;
+        snapshot->record_ends[snapshot->num_records++] = snapshot->size;
+
+        index = (index + 1) & ring.mask;
+    } while (index != ring.in_offs);
+
+    return snapshot;
+}
@@ -0,0 +1,275 @@
+/*******************************************************************************
+ * @file    snapshot.c
+ * @brief   Reply snapshot cache of aesdsocket used with the char device for
+ *          the replies not sent with sendfile() and the binary reads. The
+ *          contents of the device are read once into a reference counted
+ *          snapshot which is shared by all the clients replying at the same
+ *          generation, instead of every client reading the device on its
+ *          own.
+ *
+ *          The generation is bumped after every write to the device. A
+ *          snapshot is tagged with the generation read before the device is
+ *          read, so a write racing with the build leaves the snapshot stale
+ *          and the next client rebuilds it. Only one snapshot is built at a
+ *          time, clients arriving meanwhile share the one being built.
+ *
+ *          Writes made to the device by other processes and records evicted
+ *          by AESDCHAR_IOCSETLIMITS do not bump the generation, so the
+ *          cached snapshot is also rebuilt when the size of the device no
+ *          longer matches it. Such a change which leaves the size as it was
+ *          is not detected, aesdsocket is expected to be the only writer of
+ *          the device.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <fcntl.h>
+
+#include "aesdsocket.h"
+#include "metrics.h"
+#include "logger.h"
+
+#define SNAPSHOT_INIT_SIZE  (4 * BUFFER_MAX_SIZE)
+
+static int snapshot_fd = -1;
+static atomic_uint_fast64_t snapshot_generation;
+
+// Latest snapshot, only swapped and referenced under snapshot_lock
+static struct store_snapshot *cached_snapshot;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Held while a snapshot is built so that the device is read once
+static pthread_mutex_t build_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct store_snapshot *snapshot_cached_get(uint64_t generation, off_t size);
+static struct store_snapshot *snapshot_read(uint64_t generation);
+
+/**
+ * @brief   Opens the device the snapshots are read from.
+ *
+ * @param   path: Path of the device.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int store_snapshot_open(const char *path)
+{
+    snapshot_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (snapshot_fd < 0)
+    {
+        printf("Error while opening %s file: %s\n", path, strerror(errno));
+        syslog(LOG_ERR, "Error while opening %s file: %s", path, strerror(errno));
+        return -1;
+    }
+
+    atomic_init(&snapshot_generation, 0);
+
+    return 0;
+}
+
+/**
+ * @brief   Drops the cached snapshot and closes the device. Snapshots still
+ *          referenced by the connections are freed by them.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+void store_snapshot_close(void)
+{
+    if (cached_snapshot)
+    {
+        store_snapshot_put(cached_snapshot);
+        cached_snapshot = NULL;
+    }
+
+    if (snapshot_fd >= 0)
+    {
+        close(snapshot_fd);
+        snapshot_fd = -1;
+    }
+}
+
+/**
+ * @brief   Bumps the generation after a write, the cached snapshot is
+ *          rebuilt for the next reply.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+void store_snapshot_invalidate(void)
+{
+    atomic_fetch_add_explicit(&snapshot_generation, 1, memory_order_release);
+}
+
+/**
+ * @brief   Gets a reference to a snapshot holding at least all the writes
+ *          completed before the call. The cached snapshot is shared when its
+ *          generation and the size of the device match, otherwise the device
+ *          is read into a new one.
+ *
+ * @param   void
+ *
+ * @return  Returns the snapshot or NULL on error.
+ */
+struct store_snapshot *store_snapshot_get(void)
+{
+    struct store_snapshot *snapshot, *old_snapshot;
+    uint64_t generation = atomic_load_explicit(&snapshot_generation, memory_order_acquire);
+    off_t size;
+
+    // Snapshots are read with pread(), the position of the shared descriptor is not used
+    size = lseek(snapshot_fd, 0, SEEK_END);
+    snapshot = snapshot_cached_get(generation, size);
+
+    if (snapshot)
+        return snapshot;
+
+    pthread_mutex_lock(&build_lock);
+
+    // Snapshot may have been built while waiting for the lock
+    generation = atomic_load_explicit(&snapshot_generation, memory_order_acquire);
+    size = lseek(snapshot_fd, 0, SEEK_END);
+    snapshot = snapshot_cached_get(generation, size);
+
+    if (snapshot == NULL)
+    {
+        snapshot = snapshot_read(generation);
+
+        if (snapshot)
+        {
+            // One reference is held by the cache
+            atomic_init(&snapshot->refs, 2);
+
+            pthread_mutex_lock(&snapshot_lock);
+            old_snapshot = cached_snapshot;
+            cached_snapshot = snapshot;
+            pthread_mutex_unlock(&snapshot_lock);
+
+            if (old_snapshot)
+                store_snapshot_put(old_snapshot);
+        }
+    }
+
+    pthread_mutex_unlock(&build_lock);
+
+    return snapshot;
+}
+
+/**
+ * @brief   Releases a reference to the snapshot, the last one frees it.
+ *
+ * @param   snapshot: Snapshot returned by store_snapshot_get().
+ *
+ * @return  void
+ */
+void store_snapshot_put(struct store_snapshot *snapshot)
+{
+    if (atomic_fetch_sub_explicit(&snapshot->refs, 1, memory_order_acq_rel) == 1)
+        free(snapshot);
+}
+
+/**
+ * @brief   Gets a reference to the cached snapshot when it is of the given
+ *          generation and size.
+ *
+ * @param   generation: Generation the snapshot has to match.
+ * @param   size: Size of the device the snapshot has to match, -1 when it
+ *          is not known.
+ *
+ * @return  Returns the snapshot or NULL when it is stale or missing.
+ */
+static struct store_snapshot *snapshot_cached_get(uint64_t generation, off_t size)
+{
+    struct store_snapshot *snapshot = NULL;
+
+    pthread_mutex_lock(&snapshot_lock);
+
+    if (cached_snapshot && cached_snapshot->generation == generation && (off_t)cached_snapshot->size == size)
+    {
+        snapshot = cached_snapshot;
+        atomic_fetch_add_explicit(&snapshot->refs, 1, memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(&snapshot_lock);
+
+    if (snapshot)
+        metrics_add(METRIC_SNAPSHOT_HITS, 1);
+
+    return snapshot;
+}
+
+/**
+ * @brief   Reads the whole device into a new snapshot, the buffer is doubled
+ *          until the device is read till its end. Called with build_lock
+ *          held.
+ *
+ * @param   generation: Generation the snapshot is tagged with.
+ *
+ * @return  Returns the snapshot or NULL on error.
+ */
+static struct store_snapshot *snapshot_read(uint64_t generation)
+{
+    struct store_snapshot *snapshot, *new_snapshot;
+    size_t cap = SNAPSHOT_INIT_SIZE;
+    ssize_t ret_status;
+
+    // Start from the size of the last snapshot to avoid growing it again
+    if (cached_snapshot && cached_snapshot->size >= cap)
+        cap = cached_snapshot->size * 2;
+
+    snapshot = malloc(sizeof(struct store_snapshot) + cap);
+
+    if (snapshot == NULL)
+    {
+        LOGGER_POST(LOG_ERR, "Error while allocating memmory to snapshot", NULL, 0);
+        return NULL;
+    }
+
+    snapshot->generation = generation;
+    snapshot->size = 0;
+
+    while (true)
+    {
+        if (snapshot->size == cap)
+        {
+            cap *= 2;
+            new_snapshot = realloc(snapshot, sizeof(struct store_snapshot) + cap);
+
+            if (new_snapshot == NULL)
+            {
+                LOGGER_POST(LOG_ERR, "Error while allocating memmory to snapshot", NULL, 0);
+                free(snapshot);
+                return NULL;
+            }
+
+            snapshot = new_snapshot;
+        }
+
+        ret_status = pread(snapshot_fd, snapshot->data + snapshot->size, cap - snapshot->size, snapshot->size);
+
+        if (ret_status < 0)
+        {
+            LOGGER_POST(LOG_ERR, "Error while reading from the file", NULL, errno);
+            free(snapshot);
+            return NULL;
+        }
+
+        if (ret_status == 0)
+            break;
+
+        snapshot->size += ret_status;
+    }
+
+    metrics_add(METRIC_SNAPSHOT_BUILDS, 1);
+
+    return snapshot;
+}
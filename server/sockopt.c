@@ -0,0 +1,110 @@
+/*******************************************************************************
+ * @file    sockopt.c
+ * @brief   Socket tuning of aesdsocket. In low-latency mode (-L) replies
+ *          leave as soon as they are complete: Nagle is disabled on the
+ *          accepted sockets and a reply sent in several calls is corked
+ *          until its last byte, so it goes out in full segments without
+ *          waiting for acknowledgements. The listener accepts data in the
+ *          SYN with TCP Fast Open.
+ *
+ *          Buffer sizes (-W) are set on the listener before listen(), the
+ *          accepted sockets inherit them and the window scale is chosen for
+ *          them. Busy polling (-P) is set on every accepted socket.
+ *
+ *          Only TCP sockets are tuned, the Unix domain ones are left as is.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <syslog.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "aesdsocket.h"
+#include "logger.h"
+
+#define FASTOPEN_QUEUE_LEN  (256)
+
+/**
+ * @brief   Applies the configured options to a TCP listening socket, called
+ *          before listen(). Busy polling is disabled when not permitted.
+ *
+ * @param   listen_fd: Listening socket.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int sockopt_listener(int listen_fd)
+{
+    int qlen = FASTOPEN_QUEUE_LEN;
+    int size = server_config.sock_buf_size;
+    int busy_poll = server_config.busy_poll_us;
+
+    if (size &&
+        (setsockopt(listen_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) ||
+         setsockopt(listen_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size))))
+    {
+        perror("Failed to set socket buffer sizes");
+        syslog(LOG_ERR, "Failed to set socket buffer sizes: %s", strerror(errno));
+        return -1;
+    }
+
+    // Not fatal, clients then fall back to the regular handshake
+    if (server_config.low_latency &&
+        setsockopt(listen_fd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen)))
+    {
+        printf("TCP Fast Open not available: %s\n", strerror(errno));
+        syslog(LOG_WARNING, "TCP Fast Open not available: %s", strerror(errno));
+    }
+
+    // Probed once here instead of failing on every accepted socket
+    if (busy_poll && setsockopt(listen_fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)))
+    {
+        printf("Busy polling not available: %s\n", strerror(errno));
+        syslog(LOG_WARNING, "Busy polling not available: %s", strerror(errno));
+        server_config.busy_poll_us = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Applies the configured options to an accepted TCP socket.
+ *
+ * @param   sock_fd: Accepted client socket.
+ *
+ * @return  void
+ */
+void sockopt_accepted(int sock_fd)
+{
+    int opt = 1;
+    int busy_poll = server_config.busy_poll_us;
+
+    if (server_config.low_latency &&
+        setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)))
+        LOGGER_POST(LOG_WARNING, "Failed to disable Nagle", NULL, errno);
+
+    if (busy_poll && setsockopt(sock_fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)))
+        LOGGER_POST(LOG_WARNING, "Failed to enable busy polling", NULL, errno);
+}
+
+/**
+ * @brief   Corks or uncorks an accepted TCP socket, uncorking sends the
+ *          partial segment held back.
+ *
+ * @param   sock_fd: Accepted client socket.
+ * @param   cork: true to hold back partial segments.
+ *
+ * @return  void
+ */
+void sockopt_cork(int sock_fd, bool cork)
+{
+    int opt = cork;
+
+    if (setsockopt(sock_fd, IPPROTO_TCP, TCP_CORK, &opt, sizeof(opt)))
+        LOGGER_POST(LOG_WARNING, "Failed to cork the socket", NULL, errno);
+}
@@ -0,0 +1,329 @@
+/*******************************************************************************
+ * @file    store.c
+ * @brief   Append-only record store of aesdsocket used when the char device
+ *          is not used. The data file is mapped once with a fixed size and
+ *          preallocated in steps as it fills, so the mapping never moves and
+ *          replies are sent straight out of it.
+ *
+ *          Writers reserve space for their records with a compare-and-swap
+ *          on the tail, which packs the end offset and the number of records,
+ *          and copy the records into the mapping in parallel. Appends are
+ *          published in the order of their reservation, a writer waits for
+ *          the writers ahead of it before advancing the published size, so
+ *          readers never see a hole.
+ *
+ *          The end offset of every record is kept in an index, a record and
+ *          an offset in it are located in O(1) for the seek command.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "aesdsocket.h"
+#include "metrics.h"
+#include "logger.h"
+
+#define STORE_MAP_SIZE      ((size_t)1 << 30)
+#define STORE_GROW_SIZE     (1 << 20)
+#define STORE_OFFSET_BITS   (40)
+#define STORE_OFFSET_MASK   (((uint64_t)1 << STORE_OFFSET_BITS) - 1)
+#define STORE_MAX_RECORDS   (1 << 24)
+#define STORE_SPIN_COUNT    (64)
+
+static int store_fd = -1;
+static char *store_map;
+static uint32_t *store_index;
+
+// Reserved end offset in the low bits and number of reserved records above
+static atomic_uint_fast64_t store_reserved;
+
+// Published size and number of records, readers only look below these
+static atomic_size_t store_published;
+static atomic_uint store_num_records;
+
+// Size the file is preallocated to, grown under store_grow_lock
+static atomic_size_t store_file_size;
+static pthread_mutex_t store_grow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int store_grow(size_t size);
+
+/**
+ * @brief   Creates the data file, maps it and maps the record index. The
+ *          data left in the file by a previous run is dropped.
+ *
+ * @param   path: Path of the data file.
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int store_open(const char *path)
+{
+    store_fd = open(path, O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, S_IRWXU | S_IRWXG | S_IRWXO);
+
+    if (store_fd < 0)
+    {
+        printf("Error while opening %s file: %s\n", path, strerror(errno));
+        syslog(LOG_ERR, "Error while opening %s file: %s", path, strerror(errno));
+        return -1;
+    }
+
+    // Only the preallocated part of the mapping is backed by the file
+    store_map = mmap(NULL, STORE_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, store_fd, 0);
+
+    if (store_map == MAP_FAILED)
+    {
+        perror("Failed to map the data file");
+        syslog(LOG_ERR, "Failed to map the data file: %s", strerror(errno));
+        store_map = NULL;
+        store_close();
+        return -1;
+    }
+
+    // Pages of the index are allocated as the records are added
+    store_index = mmap(NULL, STORE_MAX_RECORDS * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (store_index == MAP_FAILED)
+    {
+        perror("Failed to map the record index");
+        syslog(LOG_ERR, "Failed to map the record index: %s", strerror(errno));
+        store_index = NULL;
+        store_close();
+        return -1;
+    }
+
+    atomic_init(&store_reserved, 0);
+    atomic_init(&store_published, 0);
+    atomic_init(&store_num_records, 0);
+    atomic_init(&store_file_size, 0);
+
+    if (store_grow(STORE_GROW_SIZE))
+    {
+        store_close();
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Unmaps the data file and the index and closes the data file. The
+ *          file is truncated to the published size.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+void store_close(void)
+{
+    if (store_index)
+    {
+        munmap(store_index, STORE_MAX_RECORDS * sizeof(uint32_t));
+        store_index = NULL;
+    }
+
+    if (store_map)
+    {
+        munmap(store_map, STORE_MAP_SIZE);
+        store_map = NULL;
+    }
+
+    if (store_fd >= 0)
+    {
+        if (ftruncate(store_fd, atomic_load(&store_published)))
+            syslog(LOG_WARNING, "Failed to truncate the data file: %s", strerror(errno));
+
+        close(store_fd);
+        store_fd = -1;
+    }
+}
+
+/**
+ * @brief   Appends records to the store, every buffer holds one record. The
+ *          records are kept together and published at once.
+ *
+ * @param   iov: Records to be appended.
+ * @param   iovcnt: Number of records.
+ *
+ * @return  Returns 0 on success and -1 with errno set on error.
+ */
+int store_append(const struct iovec *iov, int iovcnt)
+{
+    uint64_t reserved, new_reserved;
+    uint64_t wait_start_ns;
+    size_t offset, len = 0;
+    uint32_t record;
+    int spins = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        len += iov[i].iov_len;
+
+    reserved = atomic_load(&store_reserved);
+
+    do
+    {
+        offset = reserved & STORE_OFFSET_MASK;
+        record = reserved >> STORE_OFFSET_BITS;
+
+        if (offset + len > STORE_MAP_SIZE || record + iovcnt > STORE_MAX_RECORDS)
+        {
+            errno = ENOSPC;
+            return -1;
+        }
+
+        // Grown before reserving, so a reservation can never fail afterwards
+        if (offset + len > atomic_load(&store_file_size) && store_grow(offset + len))
+            return -1;
+
+        new_reserved = ((uint64_t)(record + iovcnt) << STORE_OFFSET_BITS) | (offset + len);
+    } while (!atomic_compare_exchange_weak(&store_reserved, &reserved, new_reserved));
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        memcpy(store_map + offset, iov[i].iov_base, iov[i].iov_len);
+        offset += iov[i].iov_len;
+        store_index[record + i] = offset;
+    }
+
+    // Wait for the appends reserved before this one to be published
+    wait_start_ns = 0;
+
+    while (atomic_load_explicit(&store_published, memory_order_acquire) != offset - len)
+    {
+        if (wait_start_ns == 0)
+            wait_start_ns = metrics_now();
+
+        if (++spins >= STORE_SPIN_COUNT)
+            sched_yield();
+    }
+
+    metrics_latency(METRIC_APPEND_WAIT, wait_start_ns);
+
+    atomic_store_explicit(&store_num_records, record + iovcnt, memory_order_release);
+    atomic_store_explicit(&store_published, offset, memory_order_release);
+
+    broadcast_publish();
+
+    return 0;
+}
+
+/**
+ * @brief   Gets the start of the mapping, bytes below store_size() can be
+ *          read at any time.
+ *
+ * @param   void
+ *
+ * @return  Returns the start of the mapped data file.
+ */
+const char *store_data(void)
+{
+    return store_map;
+}
+
+/**
+ * @brief   Gets the number of bytes published to the readers.
+ *
+ * @param   void
+ *
+ * @return  Returns the size of the data.
+ */
+off_t store_size(void)
+{
+    return atomic_load_explicit(&store_published, memory_order_acquire);
+}
+
+/**
+ * @brief   Gets the number of records published to the readers.
+ *
+ * @param   void
+ *
+ * @return  Returns the number of records.
+ */
+uint32_t store_records(void)
+{
+    return atomic_load_explicit(&store_num_records, memory_order_acquire);
+}
+
+/**
+ * @brief   Gets the position of the byte at an offset in a record.
+ *
+ * @param   record: Number of the record, 0 for the oldest one.
+ * @param   record_offset: Offset of the byte in the record.
+ * @param   pos: Set to the position of the byte in the data.
+ *
+ * @return  Returns 0 on success and -1 when the record or the offset does
+ *          not exist.
+ */
+int store_seek(uint32_t record, uint32_t record_offset, off_t *pos)
+{
+    uint32_t num_records = atomic_load_explicit(&store_num_records, memory_order_acquire);
+    size_t start;
+
+    if (record >= num_records)
+        return -1;
+
+    start = record ? store_index[record - 1] : 0;
+
+    if (record_offset >= store_index[record] - start)
+        return -1;
+
+    *pos = start + record_offset;
+
+    return 0;
+}
+
+/**
+ * @brief   Preallocates the data file to at least size bytes, rounded up to
+ *          the grow size.
+ *
+ * @param   size: Required size of the file.
+ *
+ * @return  Returns 0 on success and -1 with errno set on error.
+ */
+static int store_grow(size_t size)
+{
+    uint64_t wait_start_ns = metrics_now();
+    size_t new_size;
+    int ret_status = 0;
+
+    pthread_mutex_lock(&store_grow_lock);
+    metrics_latency(METRIC_APPEND_WAIT, wait_start_ns);
+
+    if (size > atomic_load(&store_file_size))
+    {
+        new_size = (size + STORE_GROW_SIZE - 1) / STORE_GROW_SIZE * STORE_GROW_SIZE;
+
+        if (new_size > STORE_MAP_SIZE)
+            new_size = STORE_MAP_SIZE;
+
+        ret_status = posix_fallocate(store_fd, 0, new_size);
+
+        if (ret_status)
+        {
+            LOGGER_POST(LOG_ERR, "Failed to grow the data file", NULL, ret_status);
+            errno = ret_status;
+            ret_status = -1;
+        }
+        else
+        {
+            atomic_store(&store_file_size, new_size);
+        }
+    }
+
+    pthread_mutex_unlock(&store_grow_lock);
+
+    return ret_status;
+}
@@ -0,0 +1,405 @@
+/*******************************************************************************
+ * @file    timer.c
+ * @brief   Timer thread of aesdsocket. Periodic and one-shot jobs are kept in
+ *          a min-heap ordered by their deadline, the timer thread sleeps on a
+ *          condition variable until the earliest deadline and runs the due
+ *          jobs. No signals are used, so blocking calls of the connection
+ *          threads are not interrupted.
+ *
+ *          Jobs run on the timer thread and must not block for long as they
+ *          delay the jobs due after them.
+ *
+ * @author  Ajay Kandagal <ajka9053@colorado.edu>
+ * @date    Oct 16th 2026
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "aesdsocket.h"
+#include "logger.h"
+
+#define TIMER_INIT_JOBS     (16)
+
+struct timer_job
+{
+    int id;
+    uint64_t deadline_ns;
+    uint64_t period_ns;     // 0 for one-shot jobs
+    timer_func_t func;
+    void *arg;
+};
+
+static struct timer_job *timer_heap;
+static int timer_heap_len;
+static int timer_heap_cap;
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;
+static pthread_cond_t timer_done_cond;
+static pthread_t timer_thread_id;
+static bool timer_running;
+static bool timer_stopping;
+
+static int next_job_id = 1;
+static int running_job_id;      // Job being run, 0 when none
+static bool running_job_cancelled;
+
+static void *timer_thread(void *arg);
+static uint64_t timer_now(void);
+static int timer_heap_reserve(void);
+static void timer_heap_push(struct timer_job *job);
+static void timer_heap_remove(int index);
+static void timer_heap_sift_up(int index);
+static void timer_heap_sift_down(int index);
+
+/**
+ * @brief   Starts the timer thread.
+ *
+ * @param   void
+ *
+ * @return  Returns 0 on success and -1 on error.
+ */
+int timer_start(void)
+{
+    pthread_condattr_t cond_attr;
+    int ret_status;
+
+    // Deadlines are on the monotonic clock so that clock changes do not affect them
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    pthread_cond_init(&timer_done_cond, NULL);
+
+    timer_stopping = false;
+
+    ret_status = pthread_create(&timer_thread_id, NULL, timer_thread, NULL);
+
+    if (ret_status != 0)
+    {
+        printf("Error while creating the timer thread: %s\n", strerror(ret_status));
+        syslog(LOG_ERR, "Error while creating the timer thread: %s", strerror(ret_status));
+        pthread_cond_destroy(&timer_cond);
+        pthread_cond_destroy(&timer_done_cond);
+        return -1;
+    }
+
+    timer_running = true;
+
+    return 0;
+}
+
+/**
+ * @brief   Stops the timer thread and drops all the scheduled jobs.
+ *
+ * @param   void
+ *
+ * @return  void
+ */
+void timer_stop(void)
+{
+    if (!timer_running)
+        return;
+
+    pthread_mutex_lock(&timer_lock);
+    timer_stopping = true;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+
+    pthread_join(timer_thread_id, NULL);
+
+    free(timer_heap);
+    timer_heap = NULL;
+    timer_heap_len = 0;
+    timer_heap_cap = 0;
+
+    pthread_cond_destroy(&timer_cond);
+    pthread_cond_destroy(&timer_done_cond);
+    timer_running = false;
+}
+
+/**
+ * @brief   Schedules a job to be run by the timer thread.
+ *
+ * @param   delay_ms: Time after which the job is run first.
+ * @param   period_ms: Interval at which the job is run again, 0 to run the
+ *          job only once.
+ * @param   func: Job function.
+ * @param   arg: Argument passed to the job function.
+ *
+ * @return  Returns the id of the job on success and -1 on error.
+ */
+int timer_schedule(unsigned int delay_ms, unsigned int period_ms, timer_func_t func, void *arg)
+{
+    struct timer_job job;
+
+    job.deadline_ns = timer_now() + (uint64_t)delay_ms * 1000000;
+    job.period_ns = (uint64_t)period_ms * 1000000;
+    job.func = func;
+    job.arg = arg;
+
+    pthread_mutex_lock(&timer_lock);
+
+    if (timer_heap_reserve() != 0)
+    {
+        pthread_mutex_unlock(&timer_lock);
+        printf("Error while allocating memmory to timer jobs\n");
+        syslog(LOG_ERR, "Error while allocating memmory to timer jobs");
+        return -1;
+    }
+
+    job.id = next_job_id++;
+    timer_heap_push(&job);
+
+    // Timer thread sleeps till the old earliest deadline
+    if (timer_heap[0].id == job.id)
+        pthread_cond_signal(&timer_cond);
+
+    pthread_mutex_unlock(&timer_lock);
+
+    return job.id;
+}
+
+/**
+ * @brief   Cancels a scheduled job. When the job is being run by the timer
+ *          thread waits for it to return, so the argument of the job can be
+ *          freed once this returns. Unless called from the job itself.
+ *
+ * @param   id: Id returned by timer_schedule.
+ *
+ * @return  void
+ */
+void timer_cancel(int id)
+{
+    int i;
+
+    pthread_mutex_lock(&timer_lock);
+
+    for (i = 0; i < timer_heap_len; i++)
+    {
+        if (timer_heap[i].id == id)
+        {
+            timer_heap_remove(i);
+            break;
+        }
+    }
+
+    if (running_job_id == id)
+    {
+        running_job_cancelled = true;
+
+        while (running_job_id == id && !pthread_equal(pthread_self(), timer_thread_id))
+            pthread_cond_wait(&timer_done_cond, &timer_lock);
+    }
+
+    pthread_mutex_unlock(&timer_lock);
+}
+
+/**
+ * @brief   Timer thread, runs the jobs once their deadline is reached until
+ *          stopped.
+ *
+ * @param   arg: Unused.
+ *
+ * @return  void
+ */
+static void *timer_thread(void *arg)
+{
+    struct timer_job job;
+    struct timespec deadline;
+    uint64_t now;
+
+    pthread_mutex_lock(&timer_lock);
+
+    while (!timer_stopping)
+    {
+        if (timer_heap_len == 0)
+        {
+            pthread_cond_wait(&timer_cond, &timer_lock);
+            continue;
+        }
+
+        now = timer_now();
+
+        if (now < timer_heap[0].deadline_ns)
+        {
+            deadline.tv_sec = timer_heap[0].deadline_ns / 1000000000;
+            deadline.tv_nsec = timer_heap[0].deadline_ns % 1000000000;
+            pthread_cond_timedwait(&timer_cond, &timer_lock, &deadline);
+            continue;
+        }
+
+        job = timer_heap[0];
+        timer_heap_remove(0);
+
+        running_job_id = job.id;
+        running_job_cancelled = false;
+
+        pthread_mutex_unlock(&timer_lock);
+        job.func(job.arg);
+        pthread_mutex_lock(&timer_lock);
+
+        running_job_id = 0;
+        pthread_cond_broadcast(&timer_done_cond);
+
+        if (job.period_ns && !running_job_cancelled)
+        {
+            // Runs missed while the thread was busy are skipped
+            job.deadline_ns += job.period_ns;
+
+            if (job.deadline_ns <= now)
+                job.deadline_ns = now + job.period_ns;
+
+            // Jobs scheduled while this one ran may have taken its slot
+            if (timer_heap_reserve() != 0)
+            {
+                LOGGER_POST(LOG_ERR, "Error while allocating memmory to timer jobs, dropping periodic job", NULL, 0);
+                continue;
+            }
+
+            timer_heap_push(&job);
+        }
+    }
+
+    pthread_mutex_unlock(&timer_lock);
+
+    return arg;
+}
+
+/**
+ * @brief   Gets the monotonic time in nanoseconds.
+ *
+ * @param   void
+ *
+ * @return  Returns the current time.
+ */
+static uint64_t timer_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief   Makes room for one more job in the heap, growing it when full.
+ *          Called with timer_lock held.
+ *
+ * @param   void
+ *
+ * @return  Returns 0 on success and -1 when the heap can't be grown.
+ */
+static int timer_heap_reserve(void)
+{
+    struct timer_job *new_heap;
+    int new_cap;
+
+    if (timer_heap_len < timer_heap_cap)
+        return 0;
+
+    new_cap = timer_heap_cap ? timer_heap_cap * 2 : TIMER_INIT_JOBS;
+    new_heap = realloc(timer_heap, new_cap * sizeof(struct timer_job));
+
+    if (new_heap == NULL)
+        return -1;
+
+    timer_heap = new_heap;
+    timer_heap_cap = new_cap;
+
+    return 0;
+}
+
+/**
+ * @brief   Adds a job to the heap. The heap must have room for it, see
+ *          timer_heap_reserve. Called with timer_lock held.
+ *
+ * @param   job: Job to be added, copied into the heap.
+ *
+ * @return  void
+ */
+static void timer_heap_push(struct timer_job *job)
+{
+    timer_heap[timer_heap_len++] = *job;
+    timer_heap_sift_up(timer_heap_len - 1);
+}
+
+/**
+ * @brief   Removes a job from the heap. Called with timer_lock held.
+ *
+ * @param   index: Position of the job in the heap.
+ *
+ * @return  void
+ */
+static void timer_heap_remove(int index)
+{
+    timer_heap_len--;
+
+    if (index == timer_heap_len)
+        return;
+
+    // Last job takes the place of the removed one, it may need to move either way
+    timer_heap[index] = timer_heap[timer_heap_len];
+    timer_heap_sift_up(index);
+    timer_heap_sift_down(index);
+}
+
+/**
+ * @brief   Moves a job towards the root of the heap until its parent is due
+ *          no later than it.
+ *
+ * @param   index: Position of the job in the heap.
+ *
+ * @return  void
+ */
+static void timer_heap_sift_up(int index)
+{
+    struct timer_job job = timer_heap[index];
+    int parent;
+
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+
+        if (timer_heap[parent].deadline_ns <= job.deadline_ns)
+            break;
+
+        timer_heap[index] = timer_heap[parent];
+        index = parent;
+    }
+
+    timer_heap[index] = job;
+}
+
+/**
+ * @brief   Moves a job towards the leaves of the heap until both of its
+ *          children are due no earlier than it.
+ *
+ * @param   index: Position of the job in the heap.
+ *
+ * @return  void
+ */
+static void timer_heap_sift_down(int index)
+{
+    struct timer_job job = timer_heap[index];
+    int child;
+
+    while ((child = 2 * index + 1) < timer_heap_len)
+    {
+        if (child + 1 < timer_heap_len && timer_heap[child + 1].deadline_ns < timer_heap[child].deadline_ns)
+            child++;
+
+        if (job.deadline_ns <= timer_heap[child].deadline_ns)
+            break;
+
+        timer_heap[index] = timer_heap[child];
+        index = child;
+    }
+
+    timer_heap[index] = job;
+}
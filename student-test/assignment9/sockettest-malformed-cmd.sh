@@ -0,0 +1,49 @@
+#!/bin/bash
+# Tests that aesdsocket closes a connection sending a malformed command
+# instead of storing the command as data. Start aesdsocket before running
+# this script, optionally pass the host and port it listens on.
+
+target=${1:-localhost}
+port=${2:-9000}
+
+# Sends a string on a new connection and prints the reply
+send_string() {
+    exec 3<>/dev/tcp/${target}/${port} || return 1
+    printf "%s" "$1" >&3
+    timeout 2 cat <&3
+    exec 3<&-
+}
+
+rc=0
+num=0
+
+for cmd in "AESDCHAR_IOCSEEKTO:1" "AESDCHAR_IOCSEEKTO:a,b" "AESDCHAR_IOCSEEKTO:1," \
+           "AESDCHAR_SUBSCRIBE:x"
+do
+    reply=$(send_string "${cmd}"$'\n')
+
+    if [ -n "${reply}" ]; then
+        echo "Malformed command \"${cmd}\" was replied to"
+        rc=1
+    fi
+
+    num=$((num + 1))
+    line="malformed command test line ${num}"
+    reply=$(send_string "${line}"$'\n')
+
+    if [[ "${reply}" == *"${cmd}"* ]]; then
+        echo "Malformed command \"${cmd}\" was stored as data"
+        rc=1
+    fi
+
+    if [[ "${reply}" != *"${line}" ]]; then
+        echo "Reply to \"${line}\" does not end with it"
+        rc=1
+    fi
+done
+
+if [ ${rc} -eq 0 ]; then
+    echo "Malformed command tests complete with success"
+fi
+
+exit ${rc}